@@ -0,0 +1,222 @@
+#ifndef FORECAST_PREFETCHER_H
+#define FORECAST_PREFETCHER_H
+
+#include "RunFile.h"
+#include "IoEngine.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// 多路归并的预测式预读（Knuth forecasting）
+// 所有输入 Run 共享一个固定大小的预读块池，由一个后台线程按预测顺序向 I/O 引擎提交块读取，
+// 引擎支持多个在途请求时（io_uring）不同 Run 的读取同时进行，每个读取完成后立即补充下一个。
+// 每个 Run 记录最近读入块的最后一个键，键最小的 Run 会最先耗尽，因此总是优先为它读取下一块。
+template <typename T>
+class ForecastPrefetcher {
+private:
+    // 每个输入 Run 的预读状态
+    struct RunState {
+        RunMetadata meta;               // 此 Run 的元数据
+        long long nextElement;          // 下一个待读取块的起始元素序号
+        bool hasLastKey;                // 是否已经读入过块
+        T lastKey;                      // 最近读入块的最后一个键（预测耗尽顺序的依据）
+        std::deque<IoBlock<T>> readyBlocks; // 已读好、等待消费的块
+        IoBlock<T> pendingBlock;        // 正在读取的预读块（每个 Run 同时最多一个在途读取）
+        bool inFlight;                  // 此 Run 有一个在途读取
+        IoBlock<T>* demandBuffer;   // 消费者已耗尽且没有可用块时，直接读入它自己的缓冲区
+        bool demandDone;                // 按需读取已完成
+
+        RunState(const RunMetadata& m)
+            : meta(m), nextElement(0), hasLastKey(false), lastKey(),
+            inFlight(false), demandBuffer(nullptr), demandDone(false) {}
+    };
+
+    IoEngine& engine;                       // 执行块读取的异步 I/O 引擎
+    int blockSize;                          // 每块的元素数量
+    std::vector<RunState> runs;
+    std::vector<IoBlock<T>> freeBlocks; // 预读块池中的空闲块
+    std::vector<IoBlock<T>> consumerBlocks; // 尚未交给 InputBuffer 的消费缓冲区
+    int inFlight;                           // 所有 Run 的在途读取总数
+
+    std::thread ioThread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop;
+    bool failed;
+
+    // 选择下一次读取的 Run：按需读取优先，否则取最先耗尽的 Run；没有可做的读取时返回 -1
+    int pickRun() {
+        if (inFlight >= engine.queueDepth()) return -1;
+        for (int i = 0; i < (int)runs.size(); ++i) {
+            if (runs[i].demandBuffer != nullptr && !runs[i].demandDone && !runs[i].inFlight) return i;
+        }
+        if (freeBlocks.empty()) return -1;
+
+        int best = -1;
+        for (int i = 0; i < (int)runs.size(); ++i) {
+            const RunState& r = runs[i];
+            if (r.inFlight || r.nextElement >= r.meta.elementCount) continue;
+            // 尚未读过块的 Run 最先需要数据
+            if (best < 0 || !r.hasLastKey ||
+                (runs[best].hasLastKey && r.lastKey < runs[best].lastKey)) {
+                best = i;
+                if (!r.hasLastKey) break;
+            }
+        }
+        return best;
+    }
+
+    // 后台线程：按预测顺序提交块读取，在途读取达到引擎队列深度或块池用尽时等待完成回调
+    void ioWorker() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            int runIdx = -1;
+            cv.wait(lock, [&] {
+                if (stop || failed) return true;
+                runIdx = pickRun();
+                return runIdx >= 0;
+            });
+            if (stop || failed) return;
+
+            RunState& r = runs[runIdx];
+            // 按需读取完成后、消费者取走之前，demandBuffer 仍然有效，此时只能做普通预读
+            bool onDemand = (r.demandBuffer != nullptr && !r.demandDone);
+            IoBlock<T>* target = r.demandBuffer;
+            if (!onDemand) {
+                r.pendingBlock = std::move(freeBlocks.back());
+                freeBlocks.pop_back();
+                target = &r.pendingBlock;
+            }
+            long long start = r.nextElement;
+            int count = (int)std::min((long long)blockSize, r.meta.elementCount - start);
+            r.nextElement += count;
+            r.inFlight = true;
+            inFlight++;
+            target->resize(count);
+
+            IoRequest request;
+            request.write = false;
+            request.data = target->data();
+            request.bytes = (long long)count * sizeof(T);
+            request.offset = r.meta.startOffset + start * (long long)sizeof(T);
+            request.onComplete = [this, runIdx, onDemand, target](bool ok) {
+                onReadComplete(runIdx, onDemand, target, ok);
+            };
+            lock.unlock();
+
+            // 在锁外提交，完成回调可能在 submit 返回前执行
+            try {
+                engine.submit(std::move(request));
+            }
+            catch (const std::exception&) {
+                onReadComplete(runIdx, onDemand, target, false);
+            }
+            lock.lock();
+        }
+    }
+
+    // 一次块读取完成：记录最后一个键，把块交给消费者或放入已读好的队列
+    void onReadComplete(int runIdx, bool onDemand, IoBlock<T>* target, bool ok) {
+        std::lock_guard<std::mutex> lock(mtx);
+        RunState& r = runs[runIdx];
+        r.inFlight = false;
+        inFlight--;
+        if (!ok) {
+            failed = true;
+        }
+        else {
+            r.hasLastKey = true;
+            r.lastKey = target->back();
+            if (onDemand) {
+                r.demandDone = true;
+            }
+            else {
+                r.readyBlocks.push_back(std::move(r.pendingBlock));
+            }
+        }
+        cv.notify_all();
+    }
+
+public:
+    // 构造函数：为 runs 创建共享的预读块池（poolBlocks 个块）和每个 Run 一个消费缓冲区，
+    // 把它们全部登记为引擎的固定缓冲区，并启动后台线程
+    ForecastPrefetcher(IoEngine& ioEngine, const std::vector<RunMetadata>& inputRuns, int blockSizeInElements, int poolBlocks)
+        : engine(ioEngine), blockSize(blockSizeInElements), inFlight(0), stop(false), failed(false)
+    {
+        for (const auto& meta : inputRuns) {
+            runs.emplace_back(meta);
+        }
+        // 块在块池与消费者之间交换，但始终是这 poolBlocks + runs.size() 块内存
+        std::vector<IoSlice> slices;
+        for (int i = 0; i < poolBlocks + (int)runs.size(); ++i) {
+            std::vector<IoBlock<T>>& owner = (i < poolBlocks) ? freeBlocks : consumerBlocks;
+            owner.emplace_back(blockSize);
+            slices.push_back(IoSlice{ owner.back().data(), blockSize * (long long)sizeof(T) });
+        }
+        engine.registerBuffers(slices);
+        ioThread = std::thread(&ForecastPrefetcher::ioWorker, this);
+    }
+
+    ~ForecastPrefetcher() {
+        std::unique_lock<std::mutex> lock(mtx);
+        stop = true;
+        cv.notify_all();
+        lock.unlock();
+        if (ioThread.joinable()) ioThread.join();
+
+        // 完成回调会访问本对象，必须等所有在途读取结束
+        lock.lock();
+        cv.wait(lock, [this] { return inFlight == 0; });
+    }
+
+    ForecastPrefetcher(const ForecastPrefetcher&) = delete;
+    ForecastPrefetcher& operator=(const ForecastPrefetcher&) = delete;
+
+    // 把一块登记过的内存换入消费者的缓冲区，之后该缓冲区与块池交换时始终使用登记过的内存
+    void attachBuffer(IoBlock<T>& buffer) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (consumerBlocks.empty()) {
+            buffer.resize(blockSize);
+            return;
+        }
+        buffer.swap(consumerBlocks.back());
+        consumerBlocks.pop_back();
+    }
+
+    // 消费者取下一块：把已读好的块换入 buffer，旧 buffer 归还块池；
+    // 没有已读好的块时让后台线程直接读入 buffer。Run 读完返回 false
+    bool nextBlock(int runIdx, IoBlock<T>& buffer) {
+        std::unique_lock<std::mutex> lock(mtx);
+        RunState& r = runs[runIdx];
+        while (true) {
+            if (failed) {
+                throw std::runtime_error("Prefetch failed while reading run.");
+            }
+            if (r.demandDone) {
+                r.demandBuffer = nullptr;
+                r.demandDone = false;
+                return true;
+            }
+            if (!r.readyBlocks.empty()) {
+                // 换入已读好的块，被换出的旧缓冲区交还给块池
+                buffer.swap(r.readyBlocks.front());
+                freeBlocks.push_back(std::move(r.readyBlocks.front()));
+                r.readyBlocks.pop_front();
+                cv.notify_all();
+                return true;
+            }
+            if (!r.inFlight && r.demandBuffer == nullptr) {
+                if (r.nextElement >= r.meta.elementCount) {
+                    return false; // 已到达此 Run 的末尾
+                }
+                r.demandBuffer = &buffer;
+                cv.notify_all();
+            }
+            cv.wait(lock);
+        }
+    }
+};
+
+#endif // FORECAST_PREFETCHER_H
\ No newline at end of file
@@ -0,0 +1,168 @@
+#ifndef IN_MEMORY_SORTER_H
+#define IN_MEMORY_SORTER_H
+
+#include "RadixSort.h"
+#include "MergeKernel.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+
+// 每个排序线程至少分到这么多元素，数据更少时减少线程数
+#ifndef IN_MEMORY_SORT_MIN_PIECE
+#define IN_MEMORY_SORT_MIN_PIECE 65536
+#endif
+
+// 内存快速路径：输入能整个放进内存预算时，不创建 RunFile、不生成 Run，
+// 直接读入、并行排序，并把结果写到目标文件
+template <typename T>
+class InMemorySorter {
+private:
+    long long memoryElements; // 内存预算（元素个数），输入连同等长的辅助缓冲区放得下才走快速路径
+    int threadCount; // 排序与归并使用的线程数
+
+    // 用至多 threadCount 个线程执行所有任务，任一任务出错时在调用线程中重新抛出
+    void runTasks(const std::vector<std::function<void()>>& tasks) {
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::mutex errorMtx;
+        auto worker = [&] {
+            size_t i;
+            while ((i = next++) < tasks.size()) {
+                try {
+                    tasks[i]();
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMtx);
+                    if (!error) error = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < std::min(threadCount, (int)tasks.size()); ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& t : workers) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // 并行排序 data[0, n)：先把数据均分成若干段由各线程分别排序，再逐轮两两归并。
+    // 每轮中每对有序段按 mergeSplit 切成若干份互不重叠的输出区间，所有线程同时归并
+    void parallelSort(T* data, T* scratch, size_t n) {
+        int pieces = (int)std::max<size_t>(1, std::min<size_t>(threadCount, n / IN_MEMORY_SORT_MIN_PIECE));
+        std::vector<size_t> bounds(pieces + 1);
+        for (int i = 0; i <= pieces; ++i) {
+            bounds[i] = n * i / pieces;
+        }
+
+        std::vector<std::function<void()>> tasks;
+        for (int i = 0; i < pieces; ++i) {
+            size_t lo = bounds[i], hi = bounds[i + 1];
+            tasks.push_back([=] { sortKeys(data + lo, data + hi, scratch + lo); });
+        }
+        runTasks(tasks);
+
+        T* src = data;
+        T* dst = scratch;
+        while (bounds.size() > 2) {
+            tasks.clear();
+            std::vector<size_t> merged;
+            for (size_t p = 0; p + 1 < bounds.size(); p += 2) {
+                merged.push_back(bounds[p]);
+                size_t lo = bounds[p];
+                if (p + 2 >= bounds.size()) {
+                    // 落单的最后一段原样复制到下一轮
+                    size_t hi = bounds[p + 1];
+                    tasks.push_back([=] { std::copy(src + lo, src + hi, dst + lo); });
+                    continue;
+                }
+                size_t mid = bounds[p + 1], hi = bounds[p + 2];
+                const T* a = src + lo;
+                const T* b = src + mid;
+                size_t na = mid - lo, nb = hi - mid;
+                size_t total = na + nb;
+                size_t parts = std::max<size_t>(1, (size_t)threadCount * total / n);
+                for (size_t s = 0; s < parts; ++s) {
+                    size_t k0 = total * s / parts, k1 = total * (s + 1) / parts;
+                    tasks.push_back([=] {
+                        size_t i0 = mergeSplit(a, na, b, nb, k0);
+                        size_t i1 = mergeSplit(a, na, b, nb, k1);
+                        size_t checkInterval = MERGE_GALLOP_INTERVAL;
+                        mergeArrays(a + i0, i1 - i0, b + (k0 - i0), (k1 - i1) - (k0 - i0), dst + lo + k0, checkInterval);
+                    });
+                }
+            }
+            merged.push_back(n);
+            runTasks(tasks);
+            bounds.swap(merged);
+            std::swap(src, dst);
+        }
+        if (src != data) {
+            std::copy(src, src + n, data);
+        }
+    }
+
+public:
+    InMemorySorter(long long memElements, int threads = 1) : memoryElements(memElements), threadCount(threads) {
+        if (threads < 1) throw std::invalid_argument("In-memory sort thread count must be >= 1");
+    }
+
+    // 由文件大小得到元素个数
+    static long long inputElementCount(const std::string& fileName) {
+        std::ifstream inputFile(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!inputFile.is_open()) {
+            throw std::runtime_error("Could not open original data file.");
+        }
+        return (long long)inputFile.tellg() / (long long)sizeof(T);
+    }
+
+    // 输入是否能整个放进内存预算：sortFile 同时持有数据与等长的辅助缓冲区，峰值占用是输入的两倍
+    bool fits(const std::string& fileName) const {
+        return inputElementCount(fileName) * 2 <= memoryElements;
+    }
+
+    // 读入整个输入文件，并行排序后写到 outputFileName，返回元素个数
+    long long sortFile(const std::string& inputFileName, const std::string& outputFileName) {
+        long long count = inputElementCount(inputFileName);
+        std::vector<T> data(count);
+        std::vector<T> scratch(count);
+
+        std::ifstream inputFile(inputFileName, std::ios::in | std::ios::binary);
+        if (!inputFile.is_open()) {
+            throw std::runtime_error("Could not open original data file.");
+        }
+        inputFile.read(reinterpret_cast<char*>(data.data()), count * (long long)sizeof(T));
+        if (inputFile.gcount() != count * (long long)sizeof(T)) {
+            throw std::runtime_error("Failed to read original data file.");
+        }
+        inputFile.close();
+
+        if (count > 0) {
+            parallelSort(data.data(), scratch.data(), (size_t)count);
+        }
+
+        std::ofstream outputFile(outputFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!outputFile.is_open()) {
+            throw std::runtime_error("Could not create sorted output file.");
+        }
+        outputFile.write(reinterpret_cast<const char*>(data.data()), count * (long long)sizeof(T));
+        if (!outputFile) {
+            throw std::runtime_error("Failed to write sorted output file.");
+        }
+        return count;
+    }
+};
+
+#endif // IN_MEMORY_SORTER_H
\ No newline at end of file
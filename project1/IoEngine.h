@@ -0,0 +1,396 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include "StorageBackend.h"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+// 定义 IO_ENGINE_NO_IO_URING 可强制使用线程池后备引擎
+#if defined(__linux__) && defined(__has_include) && !defined(IO_ENGINE_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#define IO_ENGINE_HAS_IO_URING 1
+#endif
+#endif
+
+// 异步 I/O 引擎同时在途的最大请求数
+#ifndef IO_ENGINE_QUEUE_DEPTH
+#define IO_ENGINE_QUEUE_DEPTH 64
+#endif
+
+// 内核不支持 io_uring 时，用于模拟异步 I/O 的线程数
+#ifndef IO_ENGINE_FALLBACK_THREADS
+#define IO_ENGINE_FALLBACK_THREADS 2
+#endif
+
+// 一个异步读写请求：完成后以是否成功为参数调用 onComplete
+struct IoRequest {
+    bool write;             // true 为写入，false 为读取
+    void* data;             // 读入的目标 / 写出的来源
+    long long bytes;        // 字节数
+    long long offset;       // 文件中的绝对偏移
+    std::function<void(bool)> onComplete;
+};
+
+// 异步 I/O 引擎：提交后立即返回，完成回调在引擎的完成线程上执行（也可能在 submit 返回前执行），
+// 因此提交者在调用 submit 时不能持有回调里要获取的锁。销毁引擎前所有请求都必须已经完成
+class IoEngine {
+public:
+    virtual ~IoEngine() {}
+
+    // 提交一个请求
+    virtual void submit(IoRequest request) = 0;
+
+    // 引擎能同时处理的请求数，提交者据此决定保持多少个在途请求
+    virtual int queueDepth() const = 0;
+
+    // 登记一组会反复用于 I/O 的固定缓冲区（须在提交请求之前调用），引擎可以据此省去每次请求的地址映射
+    virtual void registerBuffers(const std::vector<IoSlice>& /*buffers*/) {}
+};
+
+// 后备引擎：用少量线程按提交顺序执行同步的 pread / pwrite
+class ThreadPoolIoEngine : public IoEngine {
+private:
+    StorageBackend& storage;
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<IoRequest> queue;    // 等待执行的请求
+    bool stop;
+
+    void worker() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] { return !queue.empty() || stop; });
+            if (queue.empty()) return; // 已收到退出信号且全部执行完
+
+            IoRequest request = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+
+            bool ok = true;
+            try {
+                if (request.write) storage.writeAt(request.data, request.bytes, request.offset);
+                else storage.readAt(request.data, request.bytes, request.offset);
+            }
+            catch (const std::exception&) {
+                ok = false;
+            }
+            request.onComplete(ok);
+            lock.lock();
+        }
+    }
+
+public:
+    ThreadPoolIoEngine(StorageBackend& backend, int threads)
+        : storage(backend), stop(false)
+    {
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back(&ThreadPoolIoEngine::worker, this);
+        }
+    }
+
+    ~ThreadPoolIoEngine() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+
+    void submit(IoRequest request) override {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queue.push_back(std::move(request));
+        }
+        cv.notify_one();
+    }
+
+    int queueDepth() const override {
+        return (int)workers.size();
+    }
+};
+
+#ifdef IO_ENGINE_HAS_IO_URING
+// io_uring 引擎：一个提交队列容纳所有输入的块读取和输出的块写入，
+// 由一个完成线程收割完成事件并调用回调。直接使用系统调用，不依赖 liburing
+class UringIoEngine : public IoEngine {
+private:
+    // 一个在途请求（地址作为 user_data 传给内核）
+    struct Pending {
+        IoRequest request;
+        long long done;     // 已完成的字节数（读写不足时继续提交剩余部分）
+    };
+
+    StorageBackend& storage;
+    int fd;                 // Run 文件的描述符
+    int ringFd;
+    unsigned entries;       // 提交队列的大小，也是在途请求数的上限
+
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingBytes;
+    size_t cqRingBytes;
+    io_uring_sqe* sqes;
+    size_t sqesBytes;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    std::vector<IoSlice> registered;                    // 已登记的固定缓冲区
+    std::unordered_map<const void*, int> registeredIndex; // 缓冲区起始地址 -> 登记序号
+
+    std::thread completionThread;
+    std::mutex mtx;         // 保护提交队列与在途计数
+    std::condition_variable cv;
+    int inFlight;
+    bool stop;
+
+    UringIoEngine(StorageBackend& backend)
+        : storage(backend), fd(backend.nativeDescriptor()), ringFd(-1), entries(0),
+        sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingBytes(0), cqRingBytes(0), sqes(nullptr), sqesBytes(0),
+        inFlight(0), stop(false) {}
+
+    static int enter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    // 建立提交 / 完成队列，失败时返回 false
+    bool setup(unsigned depth) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd = (int)syscall(__NR_io_uring_setup, depth, &params);
+        if (ringFd < 0) return false;
+        entries = params.sq_entries;
+
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+        }
+        sqRing = mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = singleMap ? sqRing
+            : mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+        sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMap = mmap(nullptr, sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+        char* sq = static_cast<char*>(sqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        completionThread = std::thread(&UringIoEngine::completionWorker, this);
+        return true;
+    }
+
+    // 把请求剩余的部分放入提交队列并通知内核（调用者持有 mtx）
+    void pushLocked(Pending* p) {
+        IoRequest& r = p->request;
+        char* data = static_cast<char*>(r.data) + p->done;
+        unsigned tail = *sqTail;
+        unsigned idx = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+
+        auto it = registeredIndex.find(r.data);
+        if (it != registeredIndex.end() && r.bytes <= registered[it->second].bytes) {
+            sqe->opcode = r.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = (unsigned short)it->second;
+        }
+        else {
+            sqe->opcode = r.write ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+        sqe->fd = fd;
+        sqe->off = (unsigned long long)(r.offset + p->done);
+        sqe->addr = (unsigned long long)(uintptr_t)data;
+        sqe->len = (unsigned)(r.bytes - p->done);
+        sqe->user_data = (unsigned long long)(uintptr_t)p;
+        sqArray[idx] = idx;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        int ret;
+        do {
+            ret = enter(ringFd, 1, 0, 0);
+        } while (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+        if (ret < 0) {
+            // 进入内核失败时提交队列中的条目尚未被消费，撤回后报告错误
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+            throw std::runtime_error("io_uring submission failed.");
+        }
+    }
+
+    // 一个请求结束：调用回调并释放在途名额
+    void finish(Pending* p, bool ok) {
+        std::function<void(bool)> callback = std::move(p->request.onComplete);
+        delete p;
+        callback(ok);
+        std::lock_guard<std::mutex> lock(mtx);
+        inFlight--;
+        cv.notify_all();
+    }
+
+    // 完成线程：有在途请求时阻塞等待完成事件，读写不足的请求继续提交剩余部分
+    void completionWorker() {
+        std::unique_lock<std::mutex> lock(mtx);
+        std::vector<std::pair<Pending*, bool>> finished;
+        while (true) {
+            cv.wait(lock, [this] { return inFlight > 0 || stop; });
+            if (inFlight == 0) return; // 已收到退出信号且没有在途请求
+            lock.unlock();
+
+            enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+
+            // 在锁内收割完成队列：请求总是在提交者释放 mtx 之前入队，加锁保证看到提交者写入的请求内容
+            lock.lock();
+            finished.clear();
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                Pending* p = reinterpret_cast<Pending*>((uintptr_t)cqe.user_data);
+                int res = cqe.res;
+                bool ok = res > 0 && p->done + res == p->request.bytes;
+                if (res > 0 && p->done + res < p->request.bytes) {
+                    // 读写不足：继续提交剩余部分，仍占用原来的在途名额
+                    p->done += res;
+                    try {
+                        pushLocked(p);
+                        continue;
+                    }
+                    catch (const std::exception&) {
+                    }
+                }
+                finished.emplace_back(p, ok);
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            lock.unlock();
+
+            for (auto& f : finished) {
+                finish(f.first, f.second);
+            }
+            lock.lock();
+        }
+    }
+
+public:
+    ~UringIoEngine() {
+        if (completionThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stop = true;
+            }
+            cv.notify_all();
+            completionThread.join();
+        }
+        if (sqes) munmap(sqes, sqesBytes);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingBytes);
+        if (ringFd >= 0) ::close(ringFd);
+    }
+
+    // 为 backend 创建 io_uring 引擎，后端没有文件描述符或内核不支持时返回空
+    static std::unique_ptr<IoEngine> create(StorageBackend& backend, unsigned depth) {
+        if (backend.nativeDescriptor() < 0) return nullptr;
+        std::unique_ptr<UringIoEngine> engine(new UringIoEngine(backend));
+        if (!engine->setup(depth)) return nullptr;
+        return std::unique_ptr<IoEngine>(engine.release());
+    }
+
+    void submit(IoRequest request) override {
+        // 直接 I/O 要求偏移、长度和地址对齐，不对齐的请求交给后端同步完成
+        long long align = storage.alignment();
+        if (align > 1 && (request.offset % align != 0 || request.bytes % align != 0 ||
+            reinterpret_cast<uintptr_t>(request.data) % align != 0)) {
+            bool ok = true;
+            try {
+                if (request.write) storage.writeAt(request.data, request.bytes, request.offset);
+                else storage.readAt(request.data, request.bytes, request.offset);
+            }
+            catch (const std::exception&) {
+                ok = false;
+            }
+            request.onComplete(ok);
+            return;
+        }
+
+        Pending* p = new Pending{ std::move(request), 0 };
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return inFlight < (int)entries; });
+        try {
+            pushLocked(p);
+        }
+        catch (...) {
+            delete p;
+            throw;
+        }
+        inFlight++;
+        cv.notify_all(); // 唤醒完成线程
+    }
+
+    int queueDepth() const override {
+        return (int)entries;
+    }
+
+    void registerBuffers(const std::vector<IoSlice>& buffers) override {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (inFlight > 0) return; // 已有请求在途时不再改动登记表，这些缓冲区按普通请求提交
+
+        std::vector<IoSlice> all = registered;
+        all.insert(all.end(), buffers.begin(), buffers.end());
+        std::vector<struct iovec> iov(all.size());
+        for (size_t i = 0; i < all.size(); ++i) {
+            iov[i].iov_base = const_cast<void*>(all[i].data);
+            iov[i].iov_len = (size_t)all[i].bytes;
+        }
+        if (!registered.empty()) {
+            syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            registered.clear();
+            registeredIndex.clear();
+        }
+        // 登记失败（例如超出锁定内存限制）时不使用固定缓冲区
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iov.data(), (unsigned)iov.size()) != 0) {
+            return;
+        }
+        registered = all;
+        for (size_t i = 0; i < all.size(); ++i) {
+            registeredIndex[all[i].data] = (int)i;
+        }
+    }
+};
+#endif
+
+// 为存储后端创建异步 I/O 引擎：优先使用 io_uring，内核不支持时退回线程池 + pread / pwrite
+inline std::unique_ptr<IoEngine> makeIoEngine(StorageBackend& backend, int depth = IO_ENGINE_QUEUE_DEPTH) {
+#ifdef IO_ENGINE_HAS_IO_URING
+    std::unique_ptr<IoEngine> engine = UringIoEngine::create(backend, (unsigned)depth);
+    if (engine) return engine;
+#endif
+    return std::unique_ptr<IoEngine>(new ThreadPoolIoEngine(backend, IO_ENGINE_FALLBACK_THREADS));
+}
+
+#endif // IO_ENGINE_H
\ No newline at end of file
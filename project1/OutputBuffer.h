@@ -2,76 +2,307 @@
 #define OUTPUT_BUFFER_H
 
 #include "RunFile.h"
+#include "IoEngine.h"
 #include <vector>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 template <typename T>
 class OutputBuffer {
 private:
-    std::fstream& fileStream;   //  RunFile ļ
-    long long runStartOffset;   //  Run ļеʼƫ
-    int bufferSizeInElements;   // СԪΪλ
+    StorageBackend& storage;    // RunFile 的存储后端（按偏移写入，可与其他线程并发使用）
+    long long runStartOffset;   // 此 Run 在文件中的起始偏移
+    int bufferSizeInElements;   // 缓冲区大小（以元素为单位）
 
-    std::vector<T> buffer;      // ڴ滺
-    int currentBufferIndex;     // ǰԪ
-    long long totalElementsWritten; // д Run Ԫ
+    IoBlock<T> buffer;      // 内存缓冲区
+    int currentBufferIndex;     // 当前缓冲区中已填充的元素数量
+    long long totalElementsWritten; // 已写入此 Run 的总元素数量
 
-    // ڴ滺д
+    // 后写状态：写满的块交给后台写线程写盘，或直接作为异步写请求提交给 I/O 引擎
+    struct WriteBehindState {
+        // 等待写盘的块
+        struct PendingBlock {
+            long long elementOffset;    // 此块在 Run 中的起始元素序号
+            int count;                  // 此块中的有效元素数量
+            IoBlock<T> data;
+        };
+
+        std::thread writerThread;               // 后台写线程
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<PendingBlock> pendingBlocks; // 已写满、等待写盘的块（按 Run 内顺序排列）
+        std::vector<IoBlock<T>> freeBlocks; // 可供前台填充的空闲块
+        bool writing = false;                   // 后台线程正在写盘
+        bool stop = false;                      // 通知后台线程退出
+        bool failed = false;                    // 后台写盘出错
+        IoEngine* engine = nullptr;             // 不为空时块直接提交给 I/O 引擎，不使用后台写线程
+        int inFlight = 0;                       // 已提交给 I/O 引擎、尚未完成的写请求数
+
+        ~WriteBehindState() {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                stop = true;
+                // 完成回调会访问本状态，必须等所有异步写请求结束
+                cv.wait(lock, [this] { return inFlight == 0; });
+            }
+            cv.notify_all();
+            if (writerThread.joinable()) writerThread.join();
+        }
+    };
+    std::unique_ptr<WriteBehindState> writeBehind; // 为空表示同步写入
+
+    // 后台写线程：每次取走所有已排队的块，连续的块合并成一次聚合写（pwritev）
+    static void writeBehindWorker(WriteBehindState* state, StorageBackend* storage, long long runStartOffset) {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        while (true) {
+            state->cv.wait(lock, [state] { return !state->pendingBlocks.empty() || state->stop; });
+            if (state->pendingBlocks.empty()) return; // 已收到退出信号且全部写完
+
+            std::deque<typename WriteBehindState::PendingBlock> batch;
+            batch.swap(state->pendingBlocks);
+            state->writing = true;
+            lock.unlock();
+
+            // 在锁外完成真正的磁盘写入
+            bool ok = true;
+            try {
+                std::vector<IoSlice> slices;
+                long long batchStart = 0;
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    if (slices.empty()) batchStart = batch[i].elementOffset;
+                    IoSlice slice;
+                    slice.data = batch[i].data.data();
+                    slice.bytes = (long long)batch[i].count * sizeof(T);
+                    slices.push_back(slice);
+
+                    // 下一块不紧接在后面（或已是最后一块）时写出当前这一批
+                    if (i + 1 == batch.size() || batch[i + 1].elementOffset != batch[i].elementOffset + batch[i].count) {
+                        storage->writeGather(slices, runStartOffset + batchStart * (long long)sizeof(T));
+                        slices.clear();
+                    }
+                }
+            }
+            catch (const std::exception&) {
+                ok = false;
+            }
+
+            lock.lock();
+            for (auto& block : batch) {
+                state->freeBlocks.push_back(std::move(block.data));
+            }
+            state->writing = false;
+            if (!ok) state->failed = true;
+            state->cv.notify_all();
+        }
+    }
+
+    // 后写模式下把当前缓冲区交给后台线程，并换入一个空闲块
+    void submitBlock() {
+        std::unique_lock<std::mutex> lock(writeBehind->mtx);
+        writeBehind->cv.wait(lock, [this] { return !writeBehind->freeBlocks.empty() || writeBehind->failed; });
+        if (writeBehind->failed) {
+            throw std::runtime_error("Write-behind failed while writing run.");
+        }
+
+        typename WriteBehindState::PendingBlock block;
+        block.elementOffset = totalElementsWritten;
+        block.count = currentBufferIndex;
+        block.data.swap(buffer);
+        buffer.swap(writeBehind->freeBlocks.back());
+        writeBehind->freeBlocks.pop_back();
+        buffer.resize(bufferSizeInElements);
+
+        // 更新统计
+        totalElementsWritten += currentBufferIndex;
+        currentBufferIndex = 0;
+
+        if (!writeBehind->engine) {
+            writeBehind->pendingBlocks.push_back(std::move(block));
+            writeBehind->cv.notify_all();
+            return;
+        }
+
+        // I/O 引擎模式：每块一个异步写请求，完成后把块归还空闲池
+        writeBehind->inFlight++;
+        lock.unlock();
+        auto pending = std::make_shared<typename WriteBehindState::PendingBlock>(std::move(block));
+        WriteBehindState* state = writeBehind.get();
+        IoRequest request;
+        request.write = true;
+        request.data = pending->data.data();
+        request.bytes = (long long)pending->count * sizeof(T);
+        request.offset = runStartOffset + pending->elementOffset * (long long)sizeof(T);
+        request.onComplete = [state, pending](bool ok) {
+            std::lock_guard<std::mutex> guard(state->mtx);
+            state->freeBlocks.push_back(std::move(pending->data));
+            state->inFlight--;
+            if (!ok) state->failed = true;
+            state->cv.notify_all();
+        };
+        try {
+            state->engine->submit(std::move(request));
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> guard(state->mtx);
+            state->inFlight--;
+            state->failed = true;
+            state->cv.notify_all();
+            throw;
+        }
+    }
+
+    // 等待后台线程写完所有已提交的块
+    void drainWriteBehind() {
+        std::unique_lock<std::mutex> lock(writeBehind->mtx);
+        writeBehind->cv.wait(lock, [this] {
+            return (writeBehind->pendingBlocks.empty() && !writeBehind->writing && writeBehind->inFlight == 0) ||
+                writeBehind->failed;
+        });
+        if (writeBehind->failed) {
+            throw std::runtime_error("Write-behind failed while writing run.");
+        }
+    }
+
+    // 将内存缓冲区的数据写入磁盘
     void writeBlock() {
-        if (!fileStream.is_open() || currentBufferIndex == 0) {
-            return; // ļδ򿪻򻺳Ϊ
+        if (writeBehind) {
+            if (currentBufferIndex > 0) submitBlock();
+            return;
+        }
+        if (currentBufferIndex == 0) {
+            return; // 缓冲区为空
         }
 
-        // 㱾дļеľλ
+        // 计算本次写入在文件中的绝对位置
         long long writeOffset = runStartOffset + (totalElementsWritten * sizeof(T));
-        fileStream.seekp(writeOffset);
 
-        // дļ
-        fileStream.write(reinterpret_cast<const char*>(buffer.data()),
-            (long long)currentBufferIndex * sizeof(T));
+        // 按偏移写入，不改变任何共享的读写位置
+        storage.writeAt(buffer.data(), (long long)currentBufferIndex * sizeof(T), writeOffset);
 
-        // ͳ
+        // 更新统计
         totalElementsWritten += currentBufferIndex;
-        currentBufferIndex = 0; // û
+        currentBufferIndex = 0; // 重置缓冲区
     }
 
 public:
-    // 캯
-    OutputBuffer(std::fstream& fs, long long startOffset, int bufferSizeInElements)
-        : fileStream(fs),
+    // 构造函数
+    OutputBuffer(StorageBackend& backend, long long startOffset, int bufferSizeInElements)
+        : storage(backend),
+        runStartOffset(startOffset),
+        bufferSizeInElements(bufferSizeInElements),
+        currentBufferIndex(0),
+        totalElementsWritten(0)
+    {
+        // 预分配内存以提高效率
+        buffer.resize(bufferSizeInElements);
+    }
+
+    // 构造函数（后写模式）：最多排队 writeBehindBlocks 个待写块，由后台线程写盘
+    OutputBuffer(StorageBackend& backend, long long startOffset, int bufferSizeInElements, int writeBehindBlocks)
+        : storage(backend),
+        runStartOffset(startOffset),
+        bufferSizeInElements(bufferSizeInElements),
+        currentBufferIndex(0),
+        totalElementsWritten(0)
+    {
+        // 预分配内存以提高效率
+        buffer.resize(bufferSizeInElements);
+        if (writeBehindBlocks <= 0) {
+            return; // 退化为同步写入
+        }
+
+        writeBehind.reset(new WriteBehindState());
+        for (int i = 0; i < writeBehindBlocks; ++i) {
+            writeBehind->freeBlocks.emplace_back(bufferSizeInElements);
+        }
+        writeBehind->writerThread = std::thread(&OutputBuffer::writeBehindWorker, writeBehind.get(), &storage, runStartOffset);
+    }
+
+    // 构造函数（异步写模式）：写满的块作为异步写请求提交给共享的 I/O 引擎，最多 writeBlocks 个块同时在途
+    OutputBuffer(StorageBackend& backend, long long startOffset, int bufferSizeInElements, IoEngine& engine, int writeBlocks)
+        : storage(backend),
         runStartOffset(startOffset),
         bufferSizeInElements(bufferSizeInElements),
         currentBufferIndex(0),
         totalElementsWritten(0)
     {
-        // ԤڴЧ
+        // 预分配内存以提高效率
         buffer.resize(bufferSizeInElements);
+        if (writeBlocks <= 0) {
+            return; // 退化为同步写入
+        }
+
+        writeBehind.reset(new WriteBehindState());
+        writeBehind->engine = &engine;
+        std::vector<IoSlice> slices;
+        for (int i = 0; i < writeBlocks; ++i) {
+            writeBehind->freeBlocks.emplace_back(bufferSizeInElements);
+            slices.push_back(IoSlice{ writeBehind->freeBlocks.back().data(), bufferSizeInElements * (long long)sizeof(T) });
+        }
+        slices.push_back(IoSlice{ buffer.data(), bufferSizeInElements * (long long)sizeof(T) });
+        engine.registerBuffers(slices);
     }
 
-    // 
+    // 析构函数
     ~OutputBuffer() {
-        flush();
+        // 析构时不抛出异常，写盘错误由显式调用的 flush() 报告
+        try { flush(); } catch (...) {}
     }
 
-    // 򻺳һԪ
+    // 向缓冲区添加一个元素
     void setNextItem(const T& item) {
-        // Ԫطڴ滺
+        // 将元素放入内存缓冲区
         buffer[currentBufferIndex++] = item;
 
-        // 黺Ƿ
+        // 检查缓冲区是否已满
         if (currentBufferIndex == bufferSizeInElements) {
-            writeBlock(); // ˢ
+            writeBlock(); // 刷入磁盘
         }
     }
 
-    // ֶˢ뻺
+    // 返回缓冲区中可直接写入的连续空间，capacity 为可写入的元素数量（至少为 1）
+    T* reserveSpan(int& capacity) {
+        capacity = bufferSizeInElements - currentBufferIndex;
+        return buffer.data() + currentBufferIndex;
+    }
+
+    // 提交已写入 reserveSpan 空间的前 n 个元素，缓冲区写满时刷入磁盘
+    void commit(int n) {
+        currentBufferIndex += n;
+        if (currentBufferIndex == bufferSizeInElements) {
+            writeBlock();
+        }
+    }
+
+    // 批量写入 count 个元素：逐段填满缓冲区的空闲空间，写满的块照常刷入磁盘
+    void setItems(const T* items, long long count) {
+        while (count > 0) {
+            int capacity;
+            T* span = reserveSpan(capacity);
+            int n = (int)std::min((long long)capacity, count);
+            std::copy(items, items + n, span);
+            commit(n);
+            items += n;
+            count -= n;
+        }
+    }
+
+    // 手动刷入缓冲区
     void flush() {
         if (currentBufferIndex > 0) {
             writeBlock();
         }
-        fileStream.flush(); // ȷϵͳд
+        if (writeBehind) {
+            drainWriteBehind(); // 等待后台线程写完
+        }
+        // 按偏移写入直接进入操作系统，无需再刷新用户态的流缓冲
     }
 
-    // ȡ˻ܹд˶Ԫ
+    // 获取此缓冲区总共写入了多少元素
     long long getElementCount() const {
         return totalElementsWritten + currentBufferIndex;
     }
@@ -0,0 +1,149 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include "SimdSort.h"
+
+// 每一趟分配使用的位数（8 位为 256 个桶，11 位为 2048 个桶，32 位键只需 3 趟）
+#ifndef RADIX_SORT_DIGIT_BITS
+#define RADIX_SORT_DIGIT_BITS 8
+#endif
+
+// 元素数量少于此值时直接使用 std::sort（基数排序的计数开销此时不划算）
+#ifndef RADIX_SORT_MIN_ELEMENTS
+#define RADIX_SORT_MIN_ELEMENTS 1024
+#endif
+
+// 键变换：把 T 映射成无符号整数 Key，使 Key 的无符号大小顺序与 T 的 < 顺序一致（fromKey 为其逆变换）。
+// 不支持基数排序的类型 enabled 为 false，sortKeys 会退回 std::sort
+template <typename T, typename Enable = void>
+struct RadixTraits {
+    static const bool enabled = false;
+};
+
+// 整数：无符号数直接使用，有符号数翻转符号位
+template <typename T>
+struct RadixTraits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static const bool enabled = true;
+    typedef typename std::make_unsigned<T>::type Key;
+
+    static Key toKey(T value) {
+        Key key = static_cast<Key>(value);
+        if (std::is_signed<T>::value) {
+            key = static_cast<Key>(key ^ (Key(1) << (sizeof(Key) * 8 - 1)));
+        }
+        return key;
+    }
+
+    static T fromKey(Key key) {
+        if (std::is_signed<T>::value) {
+            key = static_cast<Key>(key ^ (Key(1) << (sizeof(Key) * 8 - 1)));
+        }
+        return static_cast<T>(key);
+    }
+};
+
+// IEEE 浮点数：正数置符号位，负数整体取反（负数的位模式越大数值越小）
+template <typename T>
+struct RadixTraits<T, typename std::enable_if<std::is_floating_point<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)>::type> {
+    static const bool enabled = true;
+    typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type Key;
+
+    static Key toKey(T value) {
+        Key key;
+        std::memcpy(&key, &value, sizeof(Key));
+        const Key signBit = Key(1) << (sizeof(Key) * 8 - 1);
+        return (key & signBit) ? ~key : (key | signBit);
+    }
+
+    static T fromKey(Key key) {
+        const Key signBit = Key(1) << (sizeof(Key) * 8 - 1);
+        key = (key & signBit) ? (key & ~signBit) : ~key;
+        T value;
+        std::memcpy(&value, &key, sizeof(Key));
+        return value;
+    }
+};
+
+namespace radix_detail {
+
+// LSD 基数排序：一趟统计所有数位的直方图，再按数位从低到高在 data 与 scratch 之间来回分配。
+// 所有元素在某一数位上都相同时跳过该趟
+template <typename T>
+void lsdRadixSort(T* data, size_t n, T* scratch) {
+    typedef RadixTraits<T> Traits;
+    typedef typename Traits::Key Key;
+    const int bits = RADIX_SORT_DIGIT_BITS;
+    const size_t buckets = size_t(1) << bits;
+    const Key mask = static_cast<Key>(buckets - 1);
+    const int digits = (int)((sizeof(Key) * 8 + bits - 1) / bits);
+
+    std::vector<size_t> counts(digits * buckets, 0);
+    for (size_t i = 0; i < n; ++i) {
+        Key key = Traits::toKey(data[i]);
+        for (int d = 0; d < digits; ++d) {
+            ++counts[d * buckets + ((key >> (d * bits)) & mask)];
+        }
+    }
+
+    T* src = data;
+    T* dst = scratch;
+    Key firstKey = Traits::toKey(data[0]);
+    for (int d = 0; d < digits; ++d) {
+        size_t* count = &counts[d * buckets];
+        int shift = d * bits;
+        if (count[(firstKey >> shift) & mask] == n) {
+            continue; // 该数位在整个数据块中是常量
+        }
+
+        size_t offset = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            size_t c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            dst[count[(Traits::toKey(src[i]) >> shift) & mask]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != data) {
+        std::copy(src, src + n, data);
+    }
+}
+
+template <typename T>
+void sortKeys(T* first, T* last, T* scratch, std::true_type) {
+    if (simdSort(first, last, scratch)) {
+        return;
+    }
+    size_t n = (size_t)(last - first);
+    if (n < RADIX_SORT_MIN_ELEMENTS) {
+        std::sort(first, last);
+        return;
+    }
+    lsdRadixSort(first, n, scratch);
+}
+
+template <typename T>
+void sortKeys(T* first, T* last, T*, std::false_type) {
+    std::sort(first, last);
+}
+
+} // namespace radix_detail
+
+// 对 [first, last) 升序排序：整数与浮点数在编译期选择基数排序，其余类型使用 std::sort。
+// 32 / 64 位有符号整数在 CPU 支持时优先使用 SimdSort.h 的向量化排序。
+// scratch 至少要有 last - first 个元素的空间（仅基数排序与向量化排序使用）
+template <typename T>
+void sortKeys(T* first, T* last, T* scratch) {
+    radix_detail::sortKeys(first, last, scratch, std::integral_constant<bool, RadixTraits<T>::enabled>());
+}
+
+#endif // RADIX_SORT_H
\ No newline at end of file
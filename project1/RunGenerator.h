@@ -3,25 +3,269 @@
 
 #include "RunFile.h"
 #include "OutputBuffer.h"
+#include "LoserTree.h"
+#include "RadixSort.h"
+#include "Presortedness.h"
 #include <fstream>
 #include <string>
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+// 写出 Run 时输出缓冲区后写模式排队的块数（0 表示同步写入）
+#ifndef RG_WRITE_BEHIND_BLOCKS
+#define RG_WRITE_BEHIND_BLOCKS 4
+#endif
+
+// 流水线模式同时使用的数据块数：一块在读入、一块在排序、一块在写出
+#ifndef RG_PIPELINE_CHUNKS
+#define RG_PIPELINE_CHUNKS 3
+#endif
 
 template <typename T>
 class RunGenerator {
 private:
-    int elementsPerRun; // ڴһοԪ
-    std::vector<T> tempBuffer; // ڲڴ滺
+    int elementsPerRun; // 内存预算（元素个数），数据块与排序辅助缓冲区都从中分配
+    int runLength; // 顺序模式下每个 Run 的长度：预算的一半，另一半给排序辅助缓冲区
+    std::vector<T> tempBuffer; // 用于内部排序的内存缓冲区
+    int sortThreads; // 流水线模式下并行排序的线程数（0 表示不使用流水线）
+    std::vector<T> sortScratch; // 排序的辅助缓冲区（与一次排序的数据等长，基数排序与自然段归并使用）
+    PresortScanner<T> presortScanner; // 按输入顺序统计预排序程度
+
+    // 流水线中的一个数据块：读入后分成若干段并行排序，写出时再把各段归并
+    struct Chunk {
+        std::vector<T> data;
+        int count = 0;                  // 有效元素数量
+        std::vector<int> pieceBounds;   // 各个有序段的边界（pieceBounds[i] 到 pieceBounds[i + 1]）
+        long long descents = 0;         // 读入时统计的逆序次数，用于选择排序策略
+    };
+
+    // 流水线各阶段之间的状态
+    struct Pipeline {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<Chunk*> freeChunks;  // 可供读入的空闲块
+        std::deque<Chunk*> toSort;      // 已读入、等待排序的块（空指针表示输入结束）
+        std::deque<Chunk*> toWrite;     // 已排序、等待写出的块（空指针表示输入结束）
+        std::exception_ptr error;       // 任一阶段出错时记录异常，其余阶段随之退出
+
+        // 取出队首的块，出错时返回空指针
+        Chunk* pop(std::deque<Chunk*>& queue) {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return !queue.empty() || error; });
+            if (error) return nullptr;
+            Chunk* chunk = queue.front();
+            queue.pop_front();
+            return chunk;
+        }
+
+        void push(std::deque<Chunk*>& queue, Chunk* chunk) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                queue.push_back(chunk);
+            }
+            cv.notify_all();
+        }
+
+        void fail(std::exception_ptr e) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!error) error = e;
+            }
+            cv.notify_all();
+        }
+    };
+
+    // 读入阶段：把原始文件依次读入空闲块，读完后发出结束标记
+    void readStage(Pipeline& pipe, std::ifstream& inputFile, int chunkElements) {
+        try {
+            while (true) {
+                Chunk* chunk = pipe.pop(pipe.freeChunks);
+                if (!chunk) return;
+                inputFile.read(reinterpret_cast<char*>(chunk->data.data()), (long long)chunkElements * sizeof(T));
+                chunk->count = (int)(inputFile.gcount() / sizeof(T));
+                chunk->descents = presortScanner.scan(chunk->data.data(), chunk->count);
+                if (chunk->count == 0) {
+                    pipe.push(pipe.toSort, nullptr);
+                    return;
+                }
+                pipe.push(pipe.toSort, chunk);
+                if (chunk->count < chunkElements) {
+                    pipe.push(pipe.toSort, nullptr);
+                    return;
+                }
+            }
+        }
+        catch (...) {
+            pipe.fail(std::current_exception());
+        }
+    }
+
+    // 对 [first, last) 排序：块内逆序较少时保留其中较长的自然升序段，只排序无序的部分
+    void sortRange(T* first, T* last, T* scratch, long long descents, long long elements) {
+        if (preferNaturalRuns(descents, elements)) {
+            sortAdaptive(first, last, scratch);
+        }
+        else {
+            sortKeys(first, last, scratch);
+        }
+    }
+
+    // 对块中的第 piece 段排序
+    void sortPiece(Chunk* chunk, int piece) {
+        T* data = chunk->data.data();
+        sortRange(data + chunk->pieceBounds[piece], data + chunk->pieceBounds[piece + 1],
+            sortScratch.data() + chunk->pieceBounds[piece], chunk->descents, chunk->count);
+    }
+
+    // 排序阶段：把块均分成 sortThreads 段，每段由一个线程排序（各段使用 sortScratch 中互不重叠的部分）
+    void sortStage(Pipeline& pipe) {
+        try {
+            while (true) {
+                Chunk* chunk = pipe.pop(pipe.toSort);
+                if (!chunk) {
+                    pipe.push(pipe.toWrite, nullptr);
+                    return;
+                }
+                int pieces = std::max(1, std::min(sortThreads, chunk->count));
+                chunk->pieceBounds.resize(pieces + 1);
+                for (int i = 0; i <= pieces; ++i) {
+                    chunk->pieceBounds[i] = (int)((long long)chunk->count * i / pieces);
+                }
+                std::vector<std::thread> workers;
+                for (int i = 1; i < pieces; ++i) {
+                    workers.emplace_back([this, chunk, i] {
+                        sortPiece(chunk, i);
+                    });
+                }
+                sortPiece(chunk, 0);
+                for (auto& t : workers) {
+                    t.join();
+                }
+                pipe.push(pipe.toWrite, chunk);
+            }
+        }
+        catch (...) {
+            pipe.fail(std::current_exception());
+        }
+    }
+
+    // 写出阶段：按读入顺序为每块分配一个 Run，用败者树归并块内的各个有序段并写出
+    void writeStage(Pipeline& pipe, RunFile& runFile, std::vector<RunMetadata>& generatedRuns) {
+        try {
+            while (true) {
+                Chunk* chunk = pipe.pop(pipe.toWrite);
+                if (!chunk) return;
+
+                int runId = runFile.allocateNewRun();
+                if (runId == -1) {
+                    throw std::runtime_error("RunFile directory is full.");
+                }
+                long long startOffset = runFile.reserveExtent((long long)chunk->count * sizeof(T));
+
+                int outputBlockSize = 1024;
+                OutputBuffer<T> outBuf(runFile.getStorage(), startOffset, outputBlockSize, RG_WRITE_BEHIND_BLOCKS);
+                int pieces = (int)chunk->pieceBounds.size() - 1;
+                bool piecesInOrder = true;
+                for (int i = 1; i < pieces && piecesInOrder; ++i) {
+                    piecesInOrder = !(chunk->data[chunk->pieceBounds[i]] < chunk->data[chunk->pieceBounds[i] - 1]);
+                }
+                if (piecesInOrder) {
+                    // 各段首尾相接（例如输入已经有序）时整块就是有序的，直接写出
+                    outBuf.setItems(chunk->data.data(), chunk->count);
+                }
+                else {
+                    // 以段序号作为叶子，胜者输出后由同一段的下一个元素补上
+                    std::vector<int> next(chunk->pieceBounds.begin(), chunk->pieceBounds.end() - 1);
+                    std::vector<RunNode<T>> heads(pieces);
+                    int activePieces = 0;
+                    for (int i = 0; i < pieces; ++i) {
+                        if (next[i] < chunk->pieceBounds[i + 1]) {
+                            heads[i] = RunNode<T>(chunk->data[next[i]++], 0);
+                            activePieces++;
+                        }
+                    }
+                    LoserTree<T> loserTree(pieces);
+                    loserTree.initialize(heads);
+                    while (!loserTree.isWinnerSentinel()) {
+                        int winner = loserTree.getWinnerIndex();
+                        outBuf.setNextItem(loserTree.getWinner().value);
+                        if (activePieces == 1) {
+                            // 只剩一段：余下的部分整段写出
+                            outBuf.setItems(chunk->data.data() + next[winner], chunk->pieceBounds[winner + 1] - next[winner]);
+                            break;
+                        }
+                        if (next[winner] < chunk->pieceBounds[winner + 1]) {
+                            loserTree.replaceWinner(chunk->data[next[winner]++], 0);
+                        }
+                        else {
+                            loserTree.setWinnerToSentinel();
+                            activePieces--;
+                        }
+                    }
+                }
+                outBuf.flush();
+
+                // 键范围：各段首元素中的最小者与尾元素中的最大者
+                T minKey = chunk->data[0];
+                T maxKey = chunk->data[chunk->pieceBounds[1] - 1];
+                for (int i = 1; i < pieces; ++i) {
+                    minKey = std::min(minKey, chunk->data[chunk->pieceBounds[i]]);
+                    maxKey = std::max(maxKey, chunk->data[chunk->pieceBounds[i + 1] - 1]);
+                }
+                runFile.updateRunMetadata(runId, startOffset, chunk->count, minKey, maxKey);
+                generatedRuns.push_back(runFile.getRunMetadata(runId));
+                pipe.push(pipe.freeChunks, chunk);
+            }
+        }
+        catch (...) {
+            pipe.fail(std::current_exception());
+        }
+    }
+
+    // 流水线模式：读入、并行排序、写出三个阶段各占一个线程同时运行。
+    // 内存预算均分给 RG_PIPELINE_CHUNKS 个块与一块等长的排序辅助缓冲区，
+    // 因此每个 Run 的长度为 elementsPerRun / (RG_PIPELINE_CHUNKS + 1)
+    std::vector<RunMetadata> generateRunsPipelined(std::ifstream& inputFile, RunFile& runFile) {
+        int chunkElements = std::max(1, elementsPerRun / (RG_PIPELINE_CHUNKS + 1));
+        std::vector<Chunk> chunks(RG_PIPELINE_CHUNKS);
+        Pipeline pipe;
+        sortScratch.resize(chunkElements);
+        for (auto& chunk : chunks) {
+            chunk.data.resize(chunkElements);
+            pipe.freeChunks.push_back(&chunk);
+        }
+
+        std::vector<RunMetadata> generatedRuns;
+        std::thread reader(&RunGenerator::readStage, this, std::ref(pipe), std::ref(inputFile), chunkElements);
+        std::thread sorter(&RunGenerator::sortStage, this, std::ref(pipe));
+        writeStage(pipe, runFile, generatedRuns);
+        reader.join();
+        sorter.join();
+
+        if (pipe.error) {
+            std::rethrow_exception(pipe.error);
+        }
+        return generatedRuns;
+    }
 
 public:
-    // 캯ָڴСʼڲ
-    RunGenerator(int elementsInMem) : elementsPerRun(elementsInMem) {
-        tempBuffer.resize(elementsInMem);
+    // 构造函数：根据指定的内存大小初始化内部缓冲区（数据与排序辅助缓冲区合计不超过 elementsInMem）
+    // sortThreads > 0 时使用流水线模式，读入、排序（sortThreads 个线程）与写出同时进行
+    RunGenerator(int elementsInMem, int sortThreads = 0)
+        : elementsPerRun(elementsInMem), runLength(std::max(1, elementsInMem / 2)), sortThreads(sortThreads) {
+        if (sortThreads <= 0) {
+            tempBuffer.resize(runLength);
+            sortScratch.resize(runLength);
+        }
     }
 
-    // ԭʼļȡݣд RunFile Run Ԫ
+    // 从原始文件读取数据，排序后写入 RunFile，并返回所有 Run 的元数据
     std::vector<RunMetadata> generateRuns(const std::string& originalFileName, RunFile& runFile) {
 
         std::vector<RunMetadata> generatedRuns;
@@ -30,51 +274,62 @@ public:
         if (!inputFile.is_open()) {
             throw std::runtime_error("Could not open original data file.");
         }
+        presortScanner.reset();
+        if (sortThreads > 0) {
+            generatedRuns = generateRunsPipelined(inputFile, runFile);
+            presortScanner.getStats().print(std::cout);
+            return generatedRuns;
+        }
 
         bool moreData = true;
         while (moreData) {
             inputFile.read(reinterpret_cast<char*>(tempBuffer.data()),
-                (long long)elementsPerRun * sizeof(T));
+                (long long)runLength * sizeof(T));
 
             int elementsRead = inputFile.gcount() / sizeof(T);
 
             if (elementsRead == 0) {
                 break;
             }
-            if (elementsRead < elementsPerRun) {
+            if (elementsRead < runLength) {
                 moreData = false;
                 tempBuffer.resize(elementsRead);
             }
 
-            std::sort(tempBuffer.begin(), tempBuffer.end());
+            long long descents = presortScanner.scan(tempBuffer.data(), elementsRead);
+            sortRange(tempBuffer.data(), tempBuffer.data() + elementsRead, sortScratch.data(), descents, elementsRead);
 
             int runId = runFile.allocateNewRun();
             if (runId == -1) {
                 throw std::runtime_error("RunFile directory is full.");
             }
 
-            long long startOffset = runFile.getAppendOffset();
+            long long startOffset = runFile.reserveExtent((long long)elementsRead * sizeof(T));
 
             int outputBlockSize = 1024;
-            OutputBuffer<T> outBuf(runFile.getStream(), startOffset, outputBlockSize);
+            OutputBuffer<T> outBuf(runFile.getStorage(), startOffset, outputBlockSize, RG_WRITE_BEHIND_BLOCKS);
 
-            for (int i = 0; i < elementsRead; ++i) {
-                outBuf.setNextItem(tempBuffer[i]);
-            }
+            outBuf.setItems(tempBuffer.data(), elementsRead);
             outBuf.flush();
 
-            runFile.updateRunMetadata(runId, startOffset, elementsRead);
+            runFile.updateRunMetadata(runId, startOffset, elementsRead, tempBuffer[0], tempBuffer[elementsRead - 1]);
 
             generatedRuns.push_back(runFile.getRunMetadata(runId));
 
             if (moreData == false) {
-                tempBuffer.resize(elementsPerRun);
+                tempBuffer.resize(runLength);
             }
         }
 
         inputFile.close();
+        presortScanner.getStats().print(std::cout);
         return generatedRuns;
     }
+
+    // 最近一次 generateRuns 扫描到的输入预排序程度
+    const PresortStats& getPresortStats() const {
+        return presortScanner.getStats();
+    }
 };
 
 #endif // RUN_GENERATOR_H
\ No newline at end of file
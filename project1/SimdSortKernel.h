@@ -0,0 +1,167 @@
+// 向量化排序内核：由 SimdSort.h 在不同的目标指令集下各包含一次（因此没有包含保护），
+// 包含前需要定义 SIMD_SORT_NS 作为这一份内核的命名空间。
+// Ops 提供向量类型 V（W 个键）、掩码类型 Mask 以及 load / store / min / max / permute / blend 等操作
+
+namespace SIMD_SORT_NS {
+
+template <typename T, typename Ops>
+struct BitonicKernel {
+    typedef typename Ops::V V;
+    typedef typename Ops::Mask Mask;
+    static const int W = Ops::W;
+    static const int LOG_W = Ops::LOG_W;
+
+    // 寄存器内双调网络每一级的置换与掩码：第 s 级中每个通道与 lane ^ d 比较，掩码为 1 的通道取较大值
+    struct Tables {
+        V partner[LOG_W];                       // partner[j]：与 lane ^ (1 << j) 交换的置换
+        Mask sortMask[LOG_W * (LOG_W + 1) / 2]; // 排序网络各级的取大掩码
+        Mask mergeMask[LOG_W];                  // 双调归并（全部升序）各级的取大掩码
+        V reverse;                              // 反转通道顺序的置换
+
+        Tables() {
+            int lanes[W];
+            bool takeMax[W];
+            for (int j = 0; j < LOG_W; ++j) {
+                int d = 1 << j;
+                for (int i = 0; i < W; ++i) {
+                    lanes[i] = i ^ d;
+                    takeMax[i] = (i & d) != 0;
+                }
+                partner[j] = Ops::indices(lanes);
+                mergeMask[j] = Ops::mask(takeMax);
+            }
+            int s = 0;
+            for (int k = 2; k <= W; k <<= 1) {
+                for (int d = k >> 1; d > 0; d >>= 1) {
+                    // 第 k 级中 (i & k) == 0 的一半升序、另一半降序
+                    for (int i = 0; i < W; ++i) {
+                        takeMax[i] = ((i & d) != 0) == ((i & k) == 0);
+                    }
+                    sortMask[s++] = Ops::mask(takeMax);
+                }
+            }
+            for (int i = 0; i < W; ++i) {
+                lanes[i] = W - 1 - i;
+            }
+            reverse = Ops::indices(lanes);
+        }
+    };
+
+    static const Tables& tables() {
+        static const Tables t;
+        return t;
+    }
+
+    static V stage(V v, V partner, Mask takeMax) {
+        V p = Ops::permute(v, partner);
+        return Ops::blend(Ops::min(v, p), Ops::max(v, p), takeMax);
+    }
+
+    // 对一个寄存器内的 W 个键排序
+    static V sortVector(V v, const Tables& t) {
+        int s = 0;
+        for (int k = 1; k <= LOG_W; ++k) {
+            for (int j = k - 1; j >= 0; --j) {
+                v = stage(v, t.partner[j], t.sortMask[s++]);
+            }
+        }
+        return v;
+    }
+
+    // 把双调序列整理成升序
+    static V cleanBitonic(V v, const Tables& t) {
+        for (int j = LOG_W - 1; j >= 0; --j) {
+            v = stage(v, t.partner[j], t.mergeMask[j]);
+        }
+        return v;
+    }
+
+    // 归并两个升序寄存器：lo 得到较小的 W 个键，hi 得到较大的 W 个键（均为升序）
+    static void merge2(V a, V b, V& lo, V& hi, const Tables& t) {
+        b = Ops::permute(b, t.reverse);
+        lo = cleanBitonic(Ops::min(a, b), t);
+        hi = cleanBitonic(Ops::max(a, b), t);
+    }
+
+    // 归并 A[0, a) 与 B[0, b) 到 out：每次从队首较小的一方装入 W 个键，与上一轮剩下的较大一半归并。
+    // 队首较小的一方不足 W 个键时，剩余部分（寄存器中的 W 个键与两边的余下部分）按标量三路归并
+    static void mergeRuns(const T* A, size_t a, const T* B, size_t b, T* out, const Tables& tables) {
+        if (a < (size_t)W || b < (size_t)W) {
+            std::merge(A, A + a, B, B + b, out);
+            return;
+        }
+        const Tables t = tables; // 局部副本，便于编译器把置换与掩码留在寄存器中
+        V va = Ops::load(A);
+        V vb = Ops::load(B);
+        size_t ia = W;
+        size_t ib = W;
+        while (true) {
+            V lo, hi;
+            merge2(va, vb, lo, hi, t);
+            Ops::store(out, lo);
+            out += W;
+            va = hi;
+            if (ia < a && (ib >= b || A[ia] <= B[ib])) {
+                if (ia + W > a) break;
+                vb = Ops::load(A + ia);
+                ia += W;
+            }
+            else if (ib < b) {
+                if (ib + W > b) break;
+                vb = Ops::load(B + ib);
+                ib += W;
+            }
+            else {
+                break;
+            }
+        }
+
+        T rest[W];
+        Ops::store(rest, va);
+        size_t ir = 0;
+        while (ir < (size_t)W || ia < a || ib < b) {
+            // 在三个队首中取最小者
+            int pick = -1;
+            T best = T();
+            if (ir < (size_t)W) { best = rest[ir]; pick = 0; }
+            if (ia < a && (pick < 0 || A[ia] < best)) { best = A[ia]; pick = 1; }
+            if (ib < b && (pick < 0 || B[ib] < best)) { best = B[ib]; pick = 2; }
+            *out++ = best;
+            if (pick == 0) ++ir;
+            else if (pick == 1) ++ia;
+            else ++ib;
+        }
+    }
+
+    // 先把每 W 个键在寄存器内排好序（末尾不足 W 个的部分用 std::sort），
+    // 再在 data 与 scratch 之间逐趟两两归并，有序段长度每趟翻倍
+    static void sort(T* data, size_t n, T* scratch) {
+        const Tables& t = tables();
+        size_t full = n / W * W;
+        for (size_t i = 0; i < full; i += W) {
+            Ops::store(data + i, sortVector(Ops::load(data + i), t));
+        }
+        std::sort(data + full, data + n);
+
+        T* src = data;
+        T* dst = scratch;
+        for (size_t width = W; width < n; width *= 2) {
+            for (size_t lo = 0; lo < n; lo += 2 * width) {
+                size_t mid = std::min(lo + width, n);
+                size_t hi = std::min(lo + 2 * width, n);
+                mergeRuns(src + lo, mid - lo, src + mid, hi - mid, dst + lo, t);
+            }
+            std::swap(src, dst);
+        }
+        if (src != data) {
+            std::copy(src, src + n, data);
+        }
+    }
+
+    // 归并两个有序数组 A[0, a) 与 B[0, b) 到 out
+    static void merge(const T* A, size_t a, const T* B, size_t b, T* out) {
+        mergeRuns(A, a, B, b, out, tables());
+    }
+};
+
+} // namespace SIMD_SORT_NS
\ No newline at end of file
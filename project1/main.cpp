@@ -1,6 +1,7 @@
 ﻿#include "RunFile.h"
 #include "RunGenerator.h"
 #include "Merger.h"
+#include "InMemorySorter.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -8,6 +9,8 @@
 #include <ctime> 
 #include <climits>
 #include <chrono>
+#include <thread>
+#include <algorithm>
 
 /* 
 * 情景设置
@@ -24,6 +27,9 @@ const int IO_BUFFER_SIZE_ELEMENTS = 1024;
 
 const std::string ORIGINAL_DATA_FILE = "original_data.dat"; // 原始数据文件
 const std::string RUN_STORAGE_FILE = "runs.dat";  // 存储归并段的文件
+const std::string SORTED_OUTPUT_FILE = "sorted_data.dat"; // 输入能放进内存时直接写出的排序结果
+const bool USE_DIRECT_IO = false; // 归并段文件是否使用直接 I/O（O_DIRECT，绕过页缓存）
+const bool USE_MMAP_INPUT = false; // 归并与验证时是否用内存映射读取已完成的 Run（适合页缓存充足的机器）
 
 // 辅助函数：生成原始数据文件
 void createOriginalDataFile(){
@@ -50,28 +56,66 @@ void createOriginalDataFile(){
 bool verifySortedRun(RunFile& runFile, const RunMetadata& finalRun) {
     std::cout << "Verifying final run..." << std::endl;
 
-    InputBuffer<T> inBuf(runFile.getStream(), finalRun, IO_BUFFER_SIZE_ELEMENTS);
-
-    T lastItem;
-    T currentItem;
+    InputBuffer<T> inBuf = USE_MMAP_INPUT
+        ? InputBuffer<T>(runFile.getStorage(), finalRun, IO_BUFFER_SIZE_ELEMENTS, MappedRead())
+        : InputBuffer<T>(runFile.getStorage(), finalRun, IO_BUFFER_SIZE_ELEMENTS);
+
+    // 按块检查：直接遍历缓冲区中的连续元素，上一个值应该<=当前值
+    T lastItem = T();
+    bool first = true;
+    int count;
+    const T* span;
+    while ((span = inBuf.peekSpan(count)) != nullptr) {
+        for (int i = 0; i < count; ++i) {
+            if (!first && span[i] < lastItem) {
+                // 顺序颠倒
+                std::cerr << "Verification FAILED: " << span[i] << " < " << lastItem << std::endl;
+                return false;
+            }
+            lastItem = span[i];
+            first = false;
+        }
+        inBuf.consume(count);
+    }
 
-    // 读取第一个
-    if (!inBuf.getNextItem(lastItem)) {
+    if (first) {
         std::cout << "Verification complete (file was empty)." << std::endl;
         return true; // 空文件认为有序
     }
 
-    // 循环比较，上一个值应该<=当前值
-    while (inBuf.getNextItem(currentItem)) {
-        if (currentItem < lastItem) {
-            // 顺序颠倒
-            std::cerr << "Verification FAILED: " << currentItem << " < " << lastItem << std::endl;
-            return false;
+    std::cout << "Verification SUCCESS: Final run is sorted." << std::endl;
+    return true;
+}
+
+// 辅助函数：验证内存快速路径写出的结果文件是否正确排序
+bool verifySortedFile(const std::string& fileName) {
+    std::cout << "Verifying sorted output file..." << std::endl;
+
+    std::ifstream inFile(fileName, std::ios::in | std::ios::binary);
+    if (!inFile.is_open()) {
+        throw std::runtime_error("Could not open sorted output file.");
+    }
+
+    std::vector<T> block(IO_BUFFER_SIZE_ELEMENTS);
+    T lastItem = T();
+    bool first = true;
+    while (true) {
+        inFile.read(reinterpret_cast<char*>(block.data()), (long long)block.size() * sizeof(T));
+        int count = (int)(inFile.gcount() / sizeof(T));
+        if (count == 0) {
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (!first && block[i] < lastItem) {
+                std::cerr << "Verification FAILED: " << block[i] << " < " << lastItem << std::endl;
+                return false;
+            }
+            lastItem = block[i];
+            first = false;
         }
-        lastItem = currentItem;
     }
 
-    std::cout << "Verification SUCCESS: Final run is sorted." << std::endl;
+    std::cout << "Verification SUCCESS: Output file is sorted." << std::endl;
     return true;
 }
 
@@ -81,18 +125,39 @@ int main() {
         // 创建初始数据
         createOriginalDataFile();
 
+        // 输入能整个放进内存时走快速路径：并行排序后直接写出结果文件，不创建归并段文件
+        InMemorySorter<T> inMemorySorter(ELEMENTS_PER_RUN_IN_MEM, std::max(1, (int)std::thread::hardware_concurrency()));
+        if (inMemorySorter.fits(ORIGINAL_DATA_FILE)) {
+            std::cout << "\n--- Input fits in memory: sorting in memory ---" << std::endl;
+            auto start_sort = std::chrono::high_resolution_clock::now();
+            long long sortedCount = inMemorySorter.sortFile(ORIGINAL_DATA_FILE, SORTED_OUTPUT_FILE);
+            auto end_sort = std::chrono::high_resolution_clock::now();
+            std::cout << "In-memory sort of " << sortedCount << " elements finished in "
+                << std::chrono::duration<double>(end_sort - start_sort).count() << "s." << std::endl;
+
+            std::cout << "\n--- Verification ---" << std::endl;
+            verifySortedFile(SORTED_OUTPUT_FILE);
+            return 0;
+        }
+
         // 初始化RunFile
         RunFile runFile(RUN_STORAGE_FILE);
-        runFile.create(20); // 理论上正好10个runs，初始化可以大一些
-        if (!runFile.open()) {
+        runFile.create(64); // 流水线生成时每个 Run 只占内存的四分之一（另一份给排序辅助缓冲区），理论上 40 个 runs，初始化可以大一些
+        std::unique_ptr<StorageBackend> backend;
+        if (USE_DIRECT_IO) {
+            backend.reset(new DirectStorageBackend());
+        }
+        if (!runFile.open(std::move(backend))) {
             throw std::runtime_error("Failed to open run file.");
         }
 
         // 阶段1：生成初始归并段
         std::cout << "\n--- Phase 1: Generating Initial Runs ---" << std::endl;
-        RunGenerator<T> generator(ELEMENTS_PER_RUN_IN_MEM); // 初始化归并段生成器
+        // 初始化归并段生成器：读入、并行排序（每个核心一个线程）与写出以流水线方式同时进行
+        int sortThreads = std::max(1, (int)std::thread::hardware_concurrency());
+        RunGenerator<T> generator(ELEMENTS_PER_RUN_IN_MEM, sortThreads);
 
-        // 调用内部sort生成10个有序归并段
+        // 调用内部sort生成有序归并段
         auto start_gen = std::chrono::high_resolution_clock::now();
         std::vector<RunMetadata> initialRuns = generator.generateRuns(ORIGINAL_DATA_FILE, runFile);
         auto end_gen = std::chrono::high_resolution_clock::now();
@@ -104,7 +169,12 @@ int main() {
 
         // 阶段2: 归并合并
         std::cout << "\n--- Phase 2: Merging Runs ---" << std::endl;
-        Merger<T> merger; // 初始化归并器
+        // 初始化归并器，归并路数由内存大小决定
+        // 二路归并时每个输入各自预读，K 路归并时所有输入共享一个按预测顺序填充的预读块池
+        // 每次归并按输出位置切成若干段（每个核心一段，缓冲区总和不超过内存预算）并行归并
+        int mergeThreads = std::max(1, (int)std::thread::hardware_concurrency());
+        Merger<T> merger(Merger<T>::fanInForMemory(ELEMENTS_PER_RUN_IN_MEM, 0, MERGE_PREFETCH_POOL_BLOCKS),
+            MERGE_READ_AHEAD_BLOCKS, MERGE_PREFETCH_POOL_BLOCKS, USE_MMAP_INPUT, mergeThreads, ELEMENTS_PER_RUN_IN_MEM);
 
         // 用外部归并排序合成一个大的有序段并记录时间
         auto start_merge = std::chrono::high_resolution_clock::now();
@@ -2,29 +2,173 @@
 #define INPUT_BUFFER_H
 
 #include "RunFile.h"
+#include "ForecastPrefetcher.h"
 #include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// 内存映射读取时每个窗口的字节数：读到一个窗口时提示内核预读下一个窗口
+#ifndef INPUT_MAP_WINDOW_BYTES
+#define INPUT_MAP_WINDOW_BYTES (4 * 1024 * 1024)
+#endif
+
+// 构造函数标记：选择内存映射读取模式
+struct MappedRead {};
 
 template <typename T>
 class InputBuffer {
 private:
-    std::fstream& fileStream;   //  RunFile ļ
-    RunMetadata runMeta;        //  Run Ԫ
-    int bufferSizeInElements;   // СԪΪλ
+    StorageBackend& storage;    // RunFile 的存储后端（按偏移读取，可与其他线程并发使用）
+    RunMetadata runMeta;        // 此 Run 的元数据
+    int bufferSizeInElements;   // 缓冲区大小（以元素为单位）
+
+    IoBlock<T> buffer;      // 内存缓冲区
+    const T* view;              // 当前可读取的数据（指向 buffer 或映射窗口）
+    int currentIndexInBuffer;   // 当前在缓冲区中读到的位置
+    int elementsInBuffer;       // 缓冲区中当前有效的元素数量
+
+    long long totalElementsRead;    // 已从此 Run 读取的总元素数量
+
+    // 预读状态：后台 I/O 线程提前把后续数据块读入空闲块
+    struct ReadAheadState {
+        std::thread ioThread;                   // 后台 I/O 线程
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<IoBlock<T>> readyBlocks; // 已读好、等待消费的块
+        std::vector<IoBlock<T>> freeBlocks; // 可供后台线程填充的空闲块
+        bool stop = false;                      // 通知后台线程退出
+        bool finished = false;                  // 后台线程已读完整个 Run（或出错）
+        bool failed = false;                    // 后台读取出错
+
+        ~ReadAheadState() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stop = true;
+            }
+            cv.notify_all();
+            if (ioThread.joinable()) ioThread.join();
+        }
+    };
+    std::unique_ptr<ReadAheadState> readAhead; // 为空表示同步读取
+
+    ForecastPrefetcher<T>* prefetcher;  // 多路归并共享的预测式预读器（为空表示不使用）
+    int prefetchRunIndex;               // 此 Run 在预读器中的序号
+
+    std::unique_ptr<MappedRegion> mapping; // 整个 Run 的只读映射（为空表示不使用）
+
+    // 后台 I/O 线程：只要有空闲块就读取下一块，直到整个 Run 读完
+    static void readAheadWorker(ReadAheadState* state, StorageBackend* storage, RunMetadata meta, int blockSize) {
+        long long nextElement = 0;
+        std::unique_lock<std::mutex> lock(state->mtx);
+        while (nextElement < meta.elementCount) {
+            state->cv.wait(lock, [state] { return !state->freeBlocks.empty() || state->stop; });
+            if (state->stop) return;
+
+            IoBlock<T> block = std::move(state->freeBlocks.back());
+            state->freeBlocks.pop_back();
+            lock.unlock();
+
+            // 在锁外完成真正的磁盘读取
+            int elementsToRead = (int)std::min((long long)blockSize, meta.elementCount - nextElement);
+            block.resize(elementsToRead);
+            bool ok = true;
+            try {
+                storage->readAt(block.data(), (long long)elementsToRead * sizeof(T),
+                    meta.startOffset + nextElement * (long long)sizeof(T));
+            }
+            catch (const std::exception&) {
+                ok = false;
+            }
+            nextElement += elementsToRead;
+
+            lock.lock();
+            if (!ok) {
+                state->failed = true;
+                break;
+            }
+            state->readyBlocks.push_back(std::move(block));
+            state->cv.notify_all();
+        }
+        state->finished = true;
+        state->cv.notify_all();
+    }
 
-    std::vector<T> buffer;      // ڴ滺
-    int currentIndexInBuffer;   // ǰڻжλ
-    int elementsInBuffer;       // еǰЧԪ
+    // 预读模式下取出下一个已读好的块，只交换缓冲区，不做磁盘读取
+    bool takeReadyBlock() {
+        std::unique_lock<std::mutex> lock(readAhead->mtx);
+        readAhead->cv.wait(lock, [this] { return !readAhead->readyBlocks.empty() || readAhead->finished; });
+        if (readAhead->readyBlocks.empty()) {
+            if (readAhead->failed) {
+                throw std::runtime_error("Read-ahead failed while reading run.");
+            }
+            return false; // 已到达此 Run 的末尾
+        }
 
-    long long totalElementsRead;    // ѴӴ Run ȡԪ
+        // 用已读好的块替换当前缓冲区，旧缓冲区交还给后台线程
+        buffer.swap(readAhead->readyBlocks.front());
+        readAhead->freeBlocks.push_back(std::move(readAhead->readyBlocks.front()));
+        readAhead->readyBlocks.pop_front();
+        readAhead->cv.notify_all();
 
-    // Ӵ̶ȡһݿ鵽ڴ滺
+        // 更新统计
+        elementsInBuffer = (int)buffer.size();
+        totalElementsRead += elementsInBuffer;
+        currentIndexInBuffer = 0;
+        return true;
+    }
+
+    // 取下一段可读取的数据：映射模式下前进一个窗口，否则读入下一块到内存缓冲区
     bool readBlock() {
-        // ǷѶ
+        if (mapping) {
+            return nextMappedWindow();
+        }
+        if (!fillBuffer()) {
+            return false;
+        }
+        view = buffer.data();
+        return true;
+    }
+
+    // 映射模式下前进到下一个窗口，直接指向映射中的数据，并提示内核预读再下一个窗口
+    bool nextMappedWindow() {
+        if (totalElementsRead >= runMeta.elementCount) {
+            return false; // 已到达此 Run 的末尾
+        }
+        int window = bufferSizeInElements;
+        int count = (int)std::min((long long)window, runMeta.elementCount - totalElementsRead);
+        view = reinterpret_cast<const T*>(mapping->data()) + totalElementsRead;
+        mapping->adviseWillNeed((totalElementsRead + count) * (long long)sizeof(T), (long long)window * sizeof(T));
+
+        elementsInBuffer = count;
+        totalElementsRead += count;
+        currentIndexInBuffer = 0;
+        return true;
+    }
+
+    // 从磁盘读取下一个数据块到内存缓冲区
+    bool fillBuffer() {
+        if (prefetcher) {
+            if (!prefetcher->nextBlock(prefetchRunIndex, buffer)) {
+                return false; // 已到达此 Run 的末尾
+            }
+            elementsInBuffer = (int)buffer.size();
+            totalElementsRead += elementsInBuffer;
+            currentIndexInBuffer = 0;
+            return true;
+        }
+        if (readAhead) {
+            return takeReadyBlock();
+        }
+
+        // 检查是否已读完
         if (totalElementsRead >= runMeta.elementCount) {
-            return false; // ѵ Run ĩβ
+            return false; // 已到达此 Run 的末尾
         }
 
-        // 㱾ҪȡԪ
+        // 计算本次要读取多少元素
         long long elementsRemainingInRun = runMeta.elementCount - totalElementsRead;
         int elementsToRead = (int)std::min((long long)bufferSizeInElements, elementsRemainingInRun);
 
@@ -32,51 +176,131 @@ private:
             return false;
         }
 
-        // 㱾ζȡļеľλ
+        // 计算本次读取在文件中的绝对位置
         long long readOffset = runMeta.startOffset + (totalElementsRead * sizeof(T));
-        fileStream.seekg(readOffset);
 
-        // ȡ
-        buffer.resize(elementsToRead); // С
-        fileStream.read(reinterpret_cast<char*>(buffer.data()),
-            (long long)elementsToRead * sizeof(T));
+        // 按偏移读取，不改变任何共享的读写位置
+        buffer.resize(elementsToRead); // 调整缓冲区大小
+        storage.readAt(buffer.data(), (long long)elementsToRead * sizeof(T), readOffset);
 
-        // ͳ
+        // 更新统计
         elementsInBuffer = elementsToRead;
         totalElementsRead += elementsToRead;
-        currentIndexInBuffer = 0; // û
+        currentIndexInBuffer = 0; // 重置缓冲区索引
 
         return true;
     }
 
 public:
-    // 캯
-    InputBuffer(std::fstream& fs, const RunMetadata& meta, int bufferSizeInElements)
-        : fileStream(fs),
+    // 构造函数
+    InputBuffer(StorageBackend& backend, const RunMetadata& meta, int bufferSizeInElements)
+        : storage(backend),
         runMeta(meta),
         bufferSizeInElements(bufferSizeInElements),
+        view(nullptr),
         currentIndexInBuffer(0),
-        elementsInBuffer(0), // ʼΪ
-        totalElementsRead(0)
+        elementsInBuffer(0), // 初始为空
+        totalElementsRead(0),
+        prefetcher(nullptr),
+        prefetchRunIndex(-1)
     {
         buffer.resize(bufferSizeInElements);
     }
 
-    // ӻȡһԪ
+    // 构造函数（预读模式）：后台线程最多提前读入 readAheadBlocks 个块
+    InputBuffer(StorageBackend& backend, const RunMetadata& meta, int bufferSizeInElements, int readAheadBlocks)
+        : storage(backend),
+        runMeta(meta),
+        bufferSizeInElements(bufferSizeInElements),
+        view(nullptr),
+        currentIndexInBuffer(0),
+        elementsInBuffer(0), // 初始为空
+        totalElementsRead(0),
+        prefetcher(nullptr),
+        prefetchRunIndex(-1)
+    {
+        buffer.resize(bufferSizeInElements);
+        if (readAheadBlocks <= 0) {
+            return; // 退化为同步读取
+        }
+
+        readAhead.reset(new ReadAheadState());
+        for (int i = 0; i < readAheadBlocks; ++i) {
+            readAhead->freeBlocks.emplace_back();
+            readAhead->freeBlocks.back().reserve(bufferSizeInElements);
+        }
+        readAhead->ioThread = std::thread(&InputBuffer::readAheadWorker, readAhead.get(), &storage, runMeta, bufferSizeInElements);
+    }
+
+    // 构造函数（预测式预读模式）：数据块由多路归并共享的 prefetcher 按预测顺序读入
+    InputBuffer(StorageBackend& backend, const RunMetadata& meta, int bufferSizeInElements,
+        ForecastPrefetcher<T>& sharedPrefetcher, int runIndex)
+        : storage(backend),
+        runMeta(meta),
+        bufferSizeInElements(bufferSizeInElements),
+        view(nullptr),
+        currentIndexInBuffer(0),
+        elementsInBuffer(0), // 初始为空
+        totalElementsRead(0),
+        prefetcher(&sharedPrefetcher),
+        prefetchRunIndex(runIndex)
+    {
+        sharedPrefetcher.attachBuffer(buffer);
+    }
+
+    // 构造函数（内存映射模式）：映射整个 Run，按 INPUT_MAP_WINDOW_BYTES 大小的窗口顺序访问，
+    // 元素直接从页缓存读取；映射不可用时退回同步读取
+    InputBuffer(StorageBackend& backend, const RunMetadata& meta, int bufferSizeInElements, MappedRead)
+        : storage(backend),
+        runMeta(meta),
+        bufferSizeInElements(bufferSizeInElements),
+        view(nullptr),
+        currentIndexInBuffer(0),
+        elementsInBuffer(0), // 初始为空
+        totalElementsRead(0),
+        prefetcher(nullptr),
+        prefetchRunIndex(-1)
+    {
+        mapping.reset(new MappedRegion(backend, meta.startOffset, meta.elementCount * (long long)sizeof(T)));
+        if (!mapping->valid()) {
+            mapping.reset();
+            buffer.resize(bufferSizeInElements);
+            return;
+        }
+        this->bufferSizeInElements = std::max(bufferSizeInElements, (int)(INPUT_MAP_WINDOW_BYTES / sizeof(T)));
+        mapping->adviseWillNeed(0, (long long)this->bufferSizeInElements * sizeof(T));
+    }
+
+    // 从缓冲区获取下一个元素
     bool getNextItem(T& item) {
-        // ڴ滺Ƿѿ
+        // 检查内存缓冲区是否已空
         if (currentIndexInBuffer >= elementsInBuffer) {
-            // ѿգԴӴ̶ȡһ
+            // 缓冲区已空，尝试从磁盘读取下一块
             if (!readBlock()) {
-                //  readBlock ʧܣ˵ Run 
+                // 如果 readBlock 失败，说明整个 Run 都读完了
                 return false;
             }
         }
 
-        // ڴ滺ṩԪ
-        item = buffer[currentIndexInBuffer++];
+        // 从内存缓冲区提供元素
+        item = view[currentIndexInBuffer++];
         return true;
     }
+
+    // 返回当前可直接读取的连续元素（必要时先读入下一块），count 为其数量；Run 已读完时返回空指针
+    const T* peekSpan(int& count) {
+        if (currentIndexInBuffer >= elementsInBuffer && !readBlock()) {
+            count = 0;
+            return nullptr;
+        }
+        count = elementsInBuffer - currentIndexInBuffer;
+        return view + currentIndexInBuffer;
+    }
+
+    // 消费 peekSpan 返回的前 n 个元素
+    void consume(int n) {
+        currentIndexInBuffer += n;
+    }
 };
 
 #endif // INPUT_BUFFER_H
\ No newline at end of file
@@ -4,150 +4,385 @@
 #include <vector>
 #include <limits>
 #include <stdexcept>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+#include "RadixSort.h"
 
-// Ԫذװ鲢 ID (Run ID)
+#include <new>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// 内部节点按块存放，每块是一棵高 LOSER_TREE_BLOCK_LEVELS 层的子树。
+// 默认 2 层：3 个 16 字节的节点正好占一条 64 字节的缓存行，重赛时每两层只访问一条缓存行
+#ifndef LOSER_TREE_BLOCK_LEVELS
+#define LOSER_TREE_BLOCK_LEVELS 2
+#endif
+
+// 重赛前预取路径上的节点（路径只由叶子序号决定，可以一次发出全部预取）
+#ifndef LOSER_TREE_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define LOSER_TREE_PREFETCH(p) __builtin_prefetch((p), 1)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define LOSER_TREE_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0)
+#else
+#define LOSER_TREE_PREFETCH(p) ((void)0)
+#endif
+#endif
+
+// 节点数组至少这么大（字节）时按大页对齐分配，Linux 下并建议内核使用透明大页，
+// 百万叶子的树因此只占几个大页，重赛时不再频繁发生 TLB 缺失
+#ifndef LOSER_TREE_HUGE_PAGE_BYTES
+#define LOSER_TREE_HUGE_PAGE_BYTES (2 * 1024 * 1024)
+#endif
+
+// 数据元素包装器，包含归并段 ID (Run ID)
 template <typename T>
 struct RunNode {
     T value;
     int runID;
 
-    // ĬϹ캯ʼΪֵڱ
+    // 默认构造函数：初始化为最大值（哨兵）
     RunNode() : value(std::numeric_limits<T>::max()), runID(std::numeric_limits<int>::max()) {}
 
     RunNode(T v, int id) : value(v), runID(id) {}
 
-    // 
+    // 不等运算符
     bool operator!=(const RunNode& other) const {
         return runID != other.runID || value != other.value;
     }
 };
 
+// 叶子的存储方式：默认直接存放 RunNode，比较时先比 RunID 再比数值
+template <typename T, typename Enable = void>
+struct LoserTreeNode {
+    typedef RunNode<T> Type;
+
+    static Type pack(const RunNode<T>& node) {
+        return node;
+    }
+
+    static RunNode<T> unpack(const Type& node) {
+        return node;
+    }
+
+    static int runID(const Type& node) {
+        return node.runID;
+    }
+
+    // 如果 playerA 输给 playerB 则返回 true（最小树，“较大者” = 败者）
+    static bool isLoser(const Type& playerA, const Type& playerB) {
+        if (playerA.runID != playerB.runID) {
+            return playerA.runID > playerB.runID; // RunID 大的输
+        }
+        return playerA.value > playerB.value; // RunID 相同，数值大的输
+    }
+};
+
+// 32 位键（整数与 float）：把 (RunID, 保序变换后的键) 打包成一个 uint64_t，RunID 在高 32 位，
+// 两级比较变成一次无符号比较，重赛时可以编译成条件传送而不是两个分支。RunID 必须非负
+template <typename T>
+struct LoserTreeNode<T, typename std::enable_if<RadixTraits<T>::enabled && sizeof(T) == 4>::type> {
+    typedef uint64_t Type;
+
+    static Type pack(const RunNode<T>& node) {
+        return ((uint64_t)(uint32_t)node.runID << 32) | (uint64_t)RadixTraits<T>::toKey(node.value);
+    }
+
+    static RunNode<T> unpack(Type node) {
+        return RunNode<T>(RadixTraits<T>::fromKey((typename RadixTraits<T>::Key)node), (int)(node >> 32));
+    }
+
+    static int runID(Type node) {
+        return (int)(node >> 32);
+    }
+
+    static bool isLoser(Type playerA, Type playerB) {
+        return playerA > playerB;
+    }
+};
+
+// 败者树节点数组的分配器：小树按类型本身的对齐分配，大树按 LOSER_TREE_HUGE_PAGE_BYTES 对齐
+template <typename T>
+struct LoserTreeAllocator {
+    typedef T value_type;
+
+    LoserTreeAllocator() noexcept {}
+    template <typename U>
+    LoserTreeAllocator(const LoserTreeAllocator<U>&) noexcept {}
+
+    static size_t alignmentFor(std::size_t n) {
+        return n * sizeof(T) >= (size_t)LOSER_TREE_HUGE_PAGE_BYTES ? (size_t)LOSER_TREE_HUGE_PAGE_BYTES : alignof(T);
+    }
+
+    T* allocate(std::size_t n) {
+        size_t alignment = alignmentFor(n);
+        void* p = ::operator new(n * sizeof(T), std::align_val_t(alignment));
+#ifdef __linux__
+        if (alignment == (size_t)LOSER_TREE_HUGE_PAGE_BYTES) {
+            size_t bytes = (n * sizeof(T) + alignment - 1) / alignment * alignment;
+            madvise(p, bytes, MADV_HUGEPAGE); // 只是建议，内核不支持时忽略
+        }
+#endif
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        ::operator delete(p, std::align_val_t(alignmentFor(n)));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const LoserTreeAllocator<T>&, const LoserTreeAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const LoserTreeAllocator<T>&, const LoserTreeAllocator<U>&) { return false; }
+
 template <typename T>
 class LoserTree {
 private:
-    std::vector<int> tree;          // ڲڵ㣺洢ߵ
-    std::vector<RunNode<T>> leaves; // Ҷӽڵ㣺洢ʵ
+    typedef LoserTreeNode<T> Node;
+    typedef typename Node::Type Key;
+
+    static const int BLOCK_LEVELS = LOSER_TREE_BLOCK_LEVELS;
+    static const int BLOCK_SLOTS = 1 << BLOCK_LEVELS;
+
+    // 内部节点：败者的键直接存放在节点中，重赛时只访问从叶子到根这条路径上的节点，不再访问叶子数组
+    struct Slot {
+        Key key;
+        int index; // 败者的叶子序号
+    };
+
+    // 一块存放一棵高 BLOCK_LEVELS 层的子树（块内按层序编号 1 .. BLOCK_SLOTS - 1，0 号槽位不用），
+    // 按缓存行对齐，重赛时路径在块内的若干层落在同一缓存行中
+    struct alignas(64) Block {
+        Slot slots[BLOCK_SLOTS];
+    };
+
+    std::vector<Block, LoserTreeAllocator<Block>> blocks; // 内部节点（堆编号 1 .. k-1），按块分层存放
+    std::vector<size_t> levelBase;      // 每个块层之前的块数
+    int shift;                          // 顶层的块缺少的层数（各块层与最底层对齐）
+    Slot winner;                        // 全局胜者（相当于原来的 tree[0]）
     int k;
 
-    // ڱʾֵ RunID
+    // 哨兵：表示无穷大（最大值，最大 RunID）
     RunNode<T> SENTINEL;
+    Key packedSentinel;
 
-    //  playerA  playerB 򷵻 true
-    // ҪСԡϴߡ = 
-    bool isLoser(const RunNode<T>& playerA, const RunNode<T>& playerB) {
-        if (playerA.runID != playerB.runID) {
-            return playerA.runID > playerB.runID; // RunID 
+    static int floorLog2(size_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll((unsigned long long)x);
+#else
+        int d = 0;
+        while (x >>= 1) ++d;
+        return d;
+#endif
+    }
+
+    // k 个叶子时各块层之前的块数（levelBase 的最后一项即总块数）与顶层的块缺少的层数
+    static void blockLayout(int k, std::vector<size_t>& levelBase, int& shift) {
+        // 内部节点共 levels 层，从最底层往上每 BLOCK_LEVELS 层为一个块层，最顶上的块层可能不满
+        int levels = (k > 1) ? floorLog2((size_t)k - 1) + 1 : 0;
+        shift = (BLOCK_LEVELS - levels % BLOCK_LEVELS) % BLOCK_LEVELS;
+        levelBase.assign(1, 0);
+        for (int level = 0; level * BLOCK_LEVELS - shift < levels; ++level) {
+            int rootDepth = std::max(0, level * BLOCK_LEVELS - shift);
+            levelBase.push_back(levelBase.back() + (size_t(1) << rootDepth));
         }
-        return playerA.value > playerB.value; // RunID ֵͬ
-    }
-
-    // Ҷӽڵ playerIndex ʼ
-    void replay(int playerIndex) {
-        int parent = (playerIndex + k) / 2;
-        int currentWinner = playerIndex;
-
-        while (parent > 0) {
-            // Ƚϵǰʤ븸ڵ洢İ
-            // ǰʤߡϴ󡱣isLoser  trueǰʤ
-            if (isLoser(leaves[currentWinner], leaves[tree[parent]])) {
-                // ǰʤߣΪߣڸڵ㣬ԭڵݣʤߣ
-                int temp = tree[parent];
-                tree[parent] = currentWinner;
-                currentWinner = temp;
+    }
+
+    // 堆编号为 h、深度为 depth 的内部节点所在的块；local 返回它在块内的层序编号
+    Block* blockAt(size_t h, int depth, size_t& local) {
+        int level = (depth + shift) / BLOCK_LEVELS;
+        int rootDepth = std::max(0, level * BLOCK_LEVELS - shift);
+        int r = depth - rootDepth;
+        size_t root = h >> r;
+        local = (size_t(1) << r) | (h & ((size_t(1) << r) - 1));
+        return &blocks[levelBase[level] + root - (size_t(1) << rootDepth)];
+    }
+
+    // 叶子 playerIndex 的键变为 key 后重赛：路径只由叶子序号决定，先预取整条路径再逐层比较
+    void replay(int playerIndex, Key key) {
+        Slot* path[64];
+        int n = 0;
+        size_t h = ((size_t)playerIndex + k) / 2;
+        if (h > 0) {
+            // 块内的父节点就是 local / 2，走到块的根（local == 1）后再定位上一层的块
+            int depth = floorLog2(h);
+            size_t local;
+            Block* block = blockAt(h, depth, local);
+            while (true) {
+                path[n] = &block->slots[local];
+                LOSER_TREE_PREFETCH(path[n]);
+                ++n;
+                if (local > 1) {
+                    local >>= 1;
+                    h >>= 1;
+                    --depth;
+                    continue;
+                }
+                if (h == 1) break;
+                h >>= 1;
+                --depth;
+                block = blockAt(h, depth, local);
             }
-            //Ӯʤ߶ϱȽ
-            parent /= 2;
         }
-        // ʤߴ洢 tree[0]
-        tree[0] = currentWinner;
+
+        Key winnerKey = key;
+        int winnerIndex = playerIndex;
+        for (int i = 0; i < n; ++i) {
+            // 比较当前胜者与节点中存放的败者；当前胜者“较大”（isLoser 返回 true）时输掉，留在节点中，
+            // 原来的败者（新胜者）继续向上。两名选手放在数组里按比较结果取下标，避免编译器生成难以预测的分支
+            Slot& s = *path[i];
+            Key keys[2] = { winnerKey, s.key };
+            int indices[2] = { winnerIndex, s.index };
+            int lost = Node::isLoser(winnerKey, keys[1]) ? 1 : 0;
+            s.key = keys[1 - lost];
+            s.index = indices[1 - lost];
+            winnerKey = keys[lost];
+            winnerIndex = indices[lost];
+        }
+        winner.key = winnerKey;
+        winner.index = winnerIndex;
     }
 
 public:
-    // 캯
+    // 构造函数
     LoserTree(int k) : k(k) {
         if (k <= 0) throw std::invalid_argument("k must be > 0");
 
-        tree.resize(k);
-        leaves.resize(k + 1); // +1  k λôڱ
-
-        // ʼڱ
+        // 初始化哨兵
         SENTINEL.value = std::numeric_limits<T>::max();
         SENTINEL.runID = std::numeric_limits<int>::max();
-        leaves[k] = SENTINEL;
+        packedSentinel = Node::pack(SENTINEL);
+
+        blockLayout(k, levelBase, shift);
+        blocks.resize(levelBase.back());
+
+        winner.key = packedSentinel;
+        winner.index = k;
     }
 
-    // ʹݳʼ
+    // 使用数据初始化败者树
     void initialize(const std::vector<T>& initialData) {
-        // 1. Ҷӽڵ㣺ݣʼ RunID = 1ڱ
-        for (int i = 0; i < k; ++i) {
-            if (i < initialData.size()) {
-                leaves[i] = RunNode<T>(initialData[i], 1);
-            }
-            else {
-                leaves[i] = SENTINEL;
-            }
+        // 填充叶子节点：填入数据（初始 RunID = 1）或哨兵
+        std::vector<Key> leaves(k + 1, packedSentinel); // +1 用于在 k 位置存放哨兵
+        for (int i = 0; i < k && i < (int)initialData.size(); ++i) {
+            leaves[i] = Node::pack(RunNode<T>(initialData[i], 1));
         }
-        leaves[k] = SENTINEL;
+        build(leaves);
+    }
+
+    // 使用带 RunID 的节点初始化败者树（K 路归并中以输入序号为叶子，空输入直接传入哨兵）
+    void initialize(const std::vector<RunNode<T>>& initialNodes) {
+        std::vector<Key> leaves(k + 1, packedSentinel);
+        for (int i = 0; i < k && i < (int)initialNodes.size(); ++i) {
+            leaves[i] = Node::pack(initialNodes[i]);
+        }
+        build(leaves);
+    }
 
-        // 2. ڲڵָڱ (k)
-        // ڹбΪա
+    // k 个叶子的节点数组实际占用的字节数，用于按内存预算确定叶子数：块层与最底层对齐，
+    // 叶子数略超过 2 的幂时块数接近翻倍；数组达到 LOSER_TREE_HUGE_PAGE_BYTES 时按大页对齐分配，大小也取整到大页
+    static size_t nodeBytes(int k) {
+        std::vector<size_t> levelBase;
+        int shift;
+        blockLayout(k, levelBase, shift);
+        size_t bytes = levelBase.back() * sizeof(Block);
+        if (bytes >= (size_t)LOSER_TREE_HUGE_PAGE_BYTES) {
+            bytes = (bytes + LOSER_TREE_HUGE_PAGE_BYTES - 1) / LOSER_TREE_HUGE_PAGE_BYTES * LOSER_TREE_HUGE_PAGE_BYTES;
+        }
+        return bytes;
+    }
+
+    // 建树时临时数组（叶子的键与各内部节点的败者序号）每个叶子占用的字节数，initialize 返回前释放
+    static size_t buildBytesPerLeaf() {
+        return sizeof(Key) + sizeof(int);
+    }
+
+    // 获取当前胜者（最小值）
+    RunNode<T> getWinner() const {
+        return Node::unpack(winner.key);
+    }
+
+    // 获取当前胜者所在的叶子序号（K 路归并中即输入 Run 的序号）
+    int getWinnerIndex() const {
+        return winner.index;
+    }
+
+    // 判断当前胜者是否为哨兵（所有叶子均已耗尽）
+    bool isWinnerSentinel() const {
+        return Node::runID(winner.key) == SENTINEL.runID;
+    }
+
+    // 替换胜者为新数值和新 RunID，然后重赛
+    void replaceWinner(T newValue, int newRunID) {
+        replay(winner.index, Node::pack(RunNode<T>(newValue, newRunID)));
+    }
+
+    // 将胜者标记为哨兵（用于输入耗尽时）
+    void setWinnerToSentinel() {
+        replay(winner.index, packedSentinel);
+    }
+
+private:
+    // 由已填充的叶子节点构建整棵树：先按堆编号构建败者序号，再连同败者的键写入分块的节点
+    void build(const std::vector<Key>& leaves) {
+        std::vector<int> tree(k);
+
+        // 1. 重置所有内部节点指向哨兵索引 (k)
+        // 这在构建过程中标记它们为“空”
         for (int i = 0; i < k; ++i) tree[i] = k;
 
-        // 3. Knuth 㷨 / 
+        // 2. 构建树（Knuth 算法 / 锦标赛构建）
         for (int i = k - 1; i >= 0; --i) {
             int current = i;
             int parent = (i + k) / 2;
 
             while (parent > 0) {
                 if (tree[parent] == k) {
-                    // ߼һߣ
-                    // ýڵΪգָڱͣ
-                    // ýڵΪһ֧ʤߡȴ֡
+                    // 访问者逻辑（第一个到达者）：
+                    // 如果该节点为空（指向哨兵），则停在这里。
+                    // 该节点成为“第一条分支的胜者”，等待对手。
                     tree[parent] = current;
                     break;
                 }
                 else {
-                    // ߼ڶߣ
-                    // Ѿѡȴʼ
+                    // 访问者逻辑（第二个到达者）：
+                    // 已经有选手在这里等待。比赛开始！
                     int other = tree[parent];
-                    if (isLoser(leaves[current], leaves[other])) {
-                        // ǰѡˡڸڵ㡣֣ʤߣϡ
+                    if (Node::isLoser(leaves[current], leaves[other])) {
+                        // 当前选手输了。留在父节点。对手（胜者）继续向上。
                         tree[parent] = current;
                         current = other;
                     }
                     else {
-                        // ǰѡӮˡ£Ϊߣǰѡּϡ
-                        // tree[parent] ֲ䡣
+                        // 当前选手赢了。对手留下（作为败者）。当前选手继续向上。
+                        // tree[parent] 保持不变。
                     }
                     parent /= 2;
                 }
             }
-            // ðݵ˶¼ȫʤ
+            // 如果冒泡到了顶部，记录全局胜者
             if (parent == 0) {
                 tree[0] = current;
             }
         }
-    }
-
-    // ȡǰʤߣСֵ
-    RunNode<T> getWinner() const {
-        return leaves[tree[0]];
-    }
 
-    // 滻ʤΪֵ RunIDȻ
-    void replaceWinner(T newValue, int newRunID) {
-        int idx = tree[0];
-        leaves[idx].value = newValue;
-        leaves[idx].runID = newRunID;
-        replay(idx);
-    }
-
-    // ʤ߱Ϊڱľʱ
-    void setWinnerToSentinel() {
-        int idx = tree[0];
-        leaves[idx] = SENTINEL;
-        replay(idx);
+        // 3. 写入分块存放的内部节点
+        for (int h = 1; h < k; ++h) {
+            size_t local;
+            Slot& s = blockAt((size_t)h, floorLog2((size_t)h), local)->slots[local];
+            s.key = leaves[tree[h]];
+            s.index = tree[h];
+        }
+        winner.key = leaves[tree[0]];
+        winner.index = tree[0];
     }
 };
 
-#endif
\ No newline at end of file
+#endif
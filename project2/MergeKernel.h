@@ -0,0 +1,165 @@
+#ifndef MERGE_KERNEL_H
+#define MERGE_KERNEL_H
+
+#include "InputBuffer.h"
+#include "OutputBuffer.h"
+#include "SimdSort.h"
+#include <algorithm>
+#include <cstddef>
+
+// 两边都至少有这么多元素时才使用向量化归并（更短时装入寄存器的开销不划算）
+#ifndef MERGE_KERNEL_SIMD_MIN_ELEMENTS
+#define MERGE_KERNEL_SIMD_MIN_ELEMENTS 64
+#endif
+
+// 一侧开头至少有这么多元素都排在另一侧队首之前时，改为倍增查找并整段复制（galloping）
+#ifndef MERGE_GALLOP_MIN
+#define MERGE_GALLOP_MIN 32
+#endif
+
+// 交错归并时每输出这么多元素检查一次能否整段复制；检查连续落空时间隔逐次加倍，最多到 16 倍
+#ifndef MERGE_GALLOP_INTERVAL
+#define MERGE_GALLOP_INTERVAL 256
+#endif
+
+// 无分支的标量两路归并：每步只比较一次，用比较结果选择输出并推进对应的指针
+template <typename T>
+void mergeArraysScalar(const T* a, size_t na, const T* b, size_t nb, T* out) {
+    const T* aEnd = a + na;
+    const T* bEnd = b + nb;
+    while (a < aEnd && b < bEnd) {
+        bool takeA = *a < *b;
+        *out++ = takeA ? *a : *b;
+        a += takeA;
+        b += !takeA;
+    }
+    out = std::copy(a, aEnd, out);
+    std::copy(b, bEnd, out);
+}
+
+// 交错归并：基本类型的键优先使用向量化双调归并，否则使用无分支标量归并
+template <typename T>
+void mergeInterleaved(const T* a, size_t na, const T* b, size_t nb, T* out) {
+    if (std::min(na, nb) >= (size_t)MERGE_KERNEL_SIMD_MIN_ELEMENTS && simdMerge(a, na, b, nb, out)) {
+        return;
+    }
+    mergeArraysScalar(a, na, b, nb, out);
+}
+
+// 归并结果的前 k 个元素由 a 的前 i 个与 b 的前 k - i 个组成，二分查找并返回 i
+template <typename T>
+size_t mergeSplit(const T* a, size_t na, const T* b, size_t nb, size_t k) {
+    size_t lo = k > nb ? k - nb : 0;
+    size_t hi = std::min(k, na);
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (a[i] < b[k - i - 1]) {
+            lo = i + 1; // a[i] 也应属于前 k 个
+        }
+        else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+// 倍增查找：a[0, n) 开头排在 key 之前的元素个数。
+// orEqual 为 true 时统计 a[x] <= key 的元素，否则统计 a[x] < key 的元素；代价为 O(log 结果)
+template <typename T>
+size_t gallop(const T* a, size_t n, const T& key, bool orEqual) {
+    size_t bound = 1;
+    while (bound <= n && (orEqual ? !(key < a[bound - 1]) : a[bound - 1] < key)) {
+        bound *= 2;
+    }
+    // a 的前 bound / 2 个都满足条件，答案在 [bound / 2, min(bound, n)] 之间
+    const T* lo = a + bound / 2;
+    const T* hi = a + std::min(bound, n);
+    return (orEqual ? std::upper_bound(lo, hi, key) : std::lower_bound(lo, hi, key)) - a;
+}
+
+// 归并有序数组 a[0, na) 与 b[0, nb) 到 out。
+// 自适应：一侧开头有至少 MERGE_GALLOP_MIN 个元素排在另一侧队首之前时，倍增查找出整段并直接复制；
+// 否则用交错归并内核处理接下来的 checkInterval 个输出，再重新检查。
+// checkInterval 由调用者在多次调用之间保存：整段复制成功时恢复为 MERGE_GALLOP_INTERVAL，落空时加倍
+template <typename T>
+void mergeArrays(const T* a, size_t na, const T* b, size_t nb, T* out, size_t& checkInterval) {
+    while (na > 0 && nb > 0) {
+        size_t run = gallop(a, na, b[0], true);
+        if (run >= (size_t)MERGE_GALLOP_MIN) {
+            out = std::copy(a, a + run, out);
+            a += run;
+            na -= run;
+            checkInterval = MERGE_GALLOP_INTERVAL;
+            continue;
+        }
+        run = gallop(b, nb, a[0], false);
+        if (run >= (size_t)MERGE_GALLOP_MIN) {
+            out = std::copy(b, b + run, out);
+            b += run;
+            nb -= run;
+            checkInterval = MERGE_GALLOP_INTERVAL;
+            continue;
+        }
+
+        size_t k = std::min(na + nb, checkInterval);
+        checkInterval = std::min(checkInterval * 2, (size_t)MERGE_GALLOP_INTERVAL * 16);
+        size_t i = mergeSplit(a, na, b, nb, k);
+        mergeInterleaved(a, i, b, k - i, out);
+        out += k;
+        a += i;
+        na -= i;
+        b += k - i;
+        nb -= k - i;
+    }
+    out = std::copy(a, a + na, out);
+    std::copy(b, b + nb, out);
+}
+
+// 按块两路归并 inA 与 inB 到 out，直到其中一个输入读完（另一个输入的剩余部分由调用者处理）。
+// 每轮直接在两个输入当前的缓冲区与输出缓冲区的空闲空间上归并，只在块边界处读入或写出：
+// 两段中不大于两段末尾较小者的元素一定排在两个输入所有后续元素之前，可以一次归并完
+template <typename T>
+void mergeTwoWay(InputBuffer<T>& inA, InputBuffer<T>& inB, OutputBuffer<T>& out) {
+    size_t checkInterval = MERGE_GALLOP_INTERVAL;
+    while (true) {
+        int na, nb, capacity;
+        const T* a = inA.peekSpan(na);
+        if (!a) return;
+        const T* b = inB.peekSpan(nb);
+        if (!b) return;
+        T* dst = out.reserveSpan(capacity);
+
+        size_t i, j;
+        if (!(b[nb - 1] < a[na - 1])) {
+            i = na;
+            j = std::upper_bound(b, b + nb, a[na - 1]) - b;
+        }
+        else {
+            j = nb;
+            i = std::upper_bound(a, a + na, b[nb - 1]) - a;
+        }
+        if (i + j > (size_t)capacity) {
+            // 输出缓冲区放不下时只归并前 capacity 个
+            i = mergeSplit(a, i, b, j, capacity);
+            j = capacity - i;
+        }
+
+        mergeArrays(a, i, b, j, dst, checkInterval);
+        inA.consume((int)i);
+        inB.consume((int)j);
+        out.commit((int)(i + j));
+    }
+}
+
+// 把 in 中剩余的所有元素整块复制到 out（归并的另一侧已经读完时使用）
+template <typename T>
+void copyRemaining(InputBuffer<T>& in, OutputBuffer<T>& out) {
+    int count;
+    const T* span;
+    while ((span = in.peekSpan(count)) != nullptr) {
+        out.setItems(span, count);
+        in.consume(count);
+    }
+}
+
+#endif // MERGE_KERNEL_H
\ No newline at end of file
@@ -4,115 +4,714 @@
 #include "RunFile.h"
 #include "InputBuffer.h"
 #include "OutputBuffer.h"
+#include "LoserTree.h"
+#include "MergeKernel.h"
+#include "RunSearcher.h"
 #include <vector>
-#include <queue> // ʹ std::priority_queue
+#include <queue> // 使用 std::priority_queue
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <map>
 
-// (ЩС屣ֲ)
+// (这些缓冲区大小定义保持不变)
 #define MERGE_INPUT_BUFFER_ELEMENTS 1024
 #define MERGE_OUTPUT_BUFFER_ELEMENTS 1024
 
+// 默认归并路数（K 路归并的扇入）
+#ifndef MERGE_DEFAULT_FAN_IN
+#define MERGE_DEFAULT_FAN_IN 16
+#endif
+
+// K 路归并时所有输入共享的预测式预读块池默认大小
+#ifndef MERGE_PREFETCH_POOL_BLOCKS
+#define MERGE_PREFETCH_POOL_BLOCKS 32
+#endif
+
+// 输出缓冲区后写模式下排队等待写盘的块数（0 表示同步写入）
+#ifndef MERGE_WRITE_BEHIND_BLOCKS
+#define MERGE_WRITE_BEHIND_BLOCKS 4
+#endif
+
+// 归并计划中的一步：把若干个计划节点合并成一个新节点
+// 计划节点编号：0 ~ N-1 为初始 Run，之后每一步产生一个新节点（编号 N + 步骤序号）
+struct MergeStep {
+    std::vector<int> inputs;   // 参与本次归并的节点编号（不含长度为 0 的虚段）
+    int output;                // 本次归并产生的节点编号
+    long long elementCount;    // 本次归并输出的元素数量
+};
+
+// K 路最佳归并树（Huffman 树）计划
+struct MergePlan {
+    int initialRunCount;            // 初始 Run 数量
+    int fanIn;                      // 实际使用的归并路数 K
+    int dummyRunCount;              // 补充的虚段数量
+    std::vector<MergeStep> steps;   // 按执行顺序排列的归并步骤
+    int finalNode;                  // 最终结果所在的节点编号
+    long long totalElementsMoved;   // 所有归并步骤读写的元素总数（每步读、写各计一次）
+};
+
 template <typename T>
 class Merger {
 private:
+    int maxFanIn;               // 每次归并最多同时合并的 Run 数量
+    int threadCount;            // 并发执行归并的线程数量
+    long long memoryBudget;     // 所有并发归并的缓冲区总和上限（以元素为单位，<= 0 表示不限制）
+    int prefetchPoolBlocks;     // K 路归并时所有输入共享的预测式预读块数（0 表示不使用）
+    bool mappedInput;           // 是否用内存映射读取输入 Run（直接访问页缓存，不使用预读）
+
+    // 为一个输入 Run 创建输入缓冲区：映射模式或同步读取
+    InputBuffer<T> openInput(RunFile& runFile, const RunMetadata& run) {
+        if (mappedInput) {
+            return InputBuffer<T>(runFile.getStorage(), run, MERGE_INPUT_BUFFER_ELEMENTS, MappedRead());
+        }
+        return InputBuffer<T>(runFile.getStorage(), run, MERGE_INPUT_BUFFER_ELEMENTS);
+    }
 
-    //ڴϵ Runs ϲһµ Run
+    //将两个在磁盘上的 Runs 合并成一个新的 Run
+    // 所有读写都按偏移定位，并发归并时可以共用同一个存储后端
     RunMetadata MergeInMem(RunFile& runFile, const RunMetadata& runA, const RunMetadata& runB) {
 
-        // 1. Ϊϲ Run Ŀ¼зһĿ
+        // 1. 为合并后的 Run 在目录中分配一个新条目
         int newRunId = runFile.allocateNewRun();
         if (newRunId == -1) {
             throw std::runtime_error("RunFile directory is full during merge.");
         }
 
-        // 2. ȡ Run дλãļĩβ
-        long long startOffset = runFile.getAppendOffset();
+        // 2. 在文件末尾为新 Run 预留物理写入区段
+        long long startOffset = runFile.reserveExtent((runA.elementCount + runB.elementCount) * (long long)sizeof(T));
 
-        // 3. 
-        InputBuffer<T> inBufA(runFile.getStream(), runA, MERGE_INPUT_BUFFER_ELEMENTS);
-        InputBuffer<T> inBufB(runFile.getStream(), runB, MERGE_INPUT_BUFFER_ELEMENTS);
-        OutputBuffer<T> outBuf(runFile.getStream(), startOffset, MERGE_OUTPUT_BUFFER_ELEMENTS);
+        // 3. 创建输入和输出缓冲区
+        InputBuffer<T> inBufA = openInput(runFile, runA);
+        InputBuffer<T> inBufB = openInput(runFile, runB);
+        OutputBuffer<T> outBuf(runFile.getStorage(), startOffset, MERGE_OUTPUT_BUFFER_ELEMENTS, MERGE_WRITE_BEHIND_BLOCKS);
+
+        // 4. K路归并（K=2）：直接在输入缓冲区与输出缓冲区的连续空间上按块归并，直到其中一个输入读完
+        mergeTwoWay(inBufA, inBufB, outBuf);
+
+        // 5. 收尾：剩余的元素整块复制
+        copyRemaining(inBufA, outBuf);
+        copyRemaining(inBufB, outBuf);
+
+        // 6. 刷入输出缓冲区
+        outBuf.flush();
+        long long totalElements = outBuf.getElementCount();
+
+        // 7. 更新 RunFile 目录中的元数据
+        runFile.updateRunMetadata(newRunId, startOffset, totalElements);
+
+        // 8. 返回新 Run 的元数据
+        return runFile.getRunMetadata(newRunId);
+    }
 
-        // 4. ԤȼصһԪ
-        T itemA, itemB;
-        bool hasA = inBufA.getNextItem(itemA);
-        bool hasB = inBufB.getNextItem(itemB);
+    // 利用败者树将多个在磁盘上的 Runs 一次性合并成一个新的 Run
+    RunMetadata MergeKWay(RunFile& runFile, const std::vector<RunMetadata>& runs) {
 
-        // 5. K·鲢K=2
-        while (hasA && hasB) {
-            if (itemA < itemB) {
-                outBuf.setNextItem(itemA);
-                hasA = inBufA.getNextItem(itemA);
+        // 1. 为合并后的 Run 在目录中分配一个新条目
+        int newRunId = runFile.allocateNewRun();
+        if (newRunId == -1) {
+            throw std::runtime_error("RunFile directory is full during merge.");
+        }
+
+        // 2. 在文件末尾为新 Run 预留物理写入区段
+        long long totalInput = 0;
+        for (const auto& run : runs) {
+            totalInput += run.elementCount;
+        }
+        long long startOffset = runFile.reserveExtent(totalInput * (long long)sizeof(T));
+
+        // 3. K 路归并写入预留的区段
+        long long totalElements = mergeRunsInto(runFile, runs, startOffset);
+
+        // 4. 更新 RunFile 目录中的元数据
+        runFile.updateRunMetadata(newRunId, startOffset, totalElements);
+
+        // 5. 返回新 Run 的元数据
+        return runFile.getRunMetadata(newRunId);
+    }
+
+    // 利用败者树将多个 Runs 归并后写到 outOffset 起始的位置，返回写出的元素数量
+    long long mergeRunsInto(RunFile& runFile, const std::vector<RunMetadata>& runs, long long outOffset) {
+
+        // 1. 每个输入 Run 一个输入缓冲区，共用一个输出缓冲区
+        //    开启预测式预读时，所有输入共享一个预读块池，优先预读最先耗尽的 Run
+        int k = (int)runs.size();
+        //    此时输入的块读取和输出的块写入都交给同一个异步 I/O 引擎（io_uring，不支持时退回线程池）
+        std::unique_ptr<IoEngine> engine;
+        if (prefetchPoolBlocks > 0 && !mappedInput) {
+            engine = makeIoEngine(runFile.getStorage());
+        }
+        OutputBuffer<T> outBuf = engine
+            ? OutputBuffer<T>(runFile.getStorage(), outOffset, MERGE_OUTPUT_BUFFER_ELEMENTS, *engine, MERGE_WRITE_BEHIND_BLOCKS)
+            : OutputBuffer<T>(runFile.getStorage(), outOffset, MERGE_OUTPUT_BUFFER_ELEMENTS, MERGE_WRITE_BEHIND_BLOCKS);
+        std::unique_ptr<ForecastPrefetcher<T>> prefetcher;
+        if (engine) {
+            prefetcher.reset(new ForecastPrefetcher<T>(*engine, runs, MERGE_INPUT_BUFFER_ELEMENTS, prefetchPoolBlocks));
+        }
+        std::vector<InputBuffer<T>> inBufs;
+        inBufs.reserve(k);
+        for (int i = 0; i < k; ++i) {
+            if (prefetcher) {
+                inBufs.emplace_back(runFile.getStorage(), runs[i], MERGE_INPUT_BUFFER_ELEMENTS, *prefetcher, i);
             }
             else {
-                outBuf.setNextItem(itemB);
-                hasB = inBufB.getNextItem(itemB);
+                inBufs.push_back(openInput(runFile, runs[i]));
             }
         }
 
-        // 6. βʣԪ
-        while (hasA) {
-            outBuf.setNextItem(itemA);
-            hasA = inBufA.getNextItem(itemA);
+        // 2. 以输入序号作为叶子初始化败者树（RunID 统一为 0，空的 Run 直接作为哨兵）
+        std::vector<RunNode<T>> heads(k);
+        T item;
+        int activeInputs = 0; // 尚未读完的输入数量
+        for (int i = 0; i < k; ++i) {
+            if (inBufs[i].getNextItem(item)) {
+                heads[i] = RunNode<T>(item, 0);
+                activeInputs++;
+            }
         }
-        while (hasB) {
-            outBuf.setNextItem(itemB);
-            hasB = inBufB.getNextItem(itemB);
+        LoserTree<T> loserTree(k);
+        loserTree.initialize(heads);
+
+        // 3. K路归并：输出胜者，再从胜者所在的 Run 补充下一个元素
+        while (!loserTree.isWinnerSentinel()) {
+            int winner = loserTree.getWinnerIndex();
+            outBuf.setNextItem(loserTree.getWinner().value);
+
+            if (activeInputs == 1) {
+                // 只剩一个输入：其余部分不必再经过败者树，整块复制
+                copyRemaining(inBufs[winner], outBuf);
+                break;
+            }
+            if (inBufs[winner].getNextItem(item)) {
+                loserTree.replaceWinner(item, 0);
+            }
+            else {
+                loserTree.setWinnerToSentinel();
+                activeInputs--;
+            }
         }
 
-        // 7. ˢ
+        // 4. 刷入输出缓冲区
         outBuf.flush();
-        long long totalElements = outBuf.getElementCount();
+        return outBuf.getElementCount();
+    }
 
-        // 8.  RunFile Ŀ¼еԪ
-        runFile.updateRunMetadata(newRunId, startOffset, totalElements);
+    // 多序列划分（co-rank）：求每个 Run 的切分位置，使切分点之前的元素恰为全体中最小的 rank 个
+    // 相等元素按 Run 序号先后分配，保证各段的键范围互不交叉。
+    // 切分位置始终在各 Run 的窗口 [lo, hi) 内：窗口之前的元素都小于此前向上收缩时的枢轴，
+    // 窗口之后的都大于向下收缩时的枢轴，因此只需在窗口内二分
+    std::vector<long long> coRank(std::vector<RunSearcher<T>>& searchers, long long rank) {
+        int k = (int)searchers.size();
+        std::vector<long long> lo(k, 0), hi(k);
+        for (int j = 0; j < k; ++j) hi[j] = searchers[j].size();
+
+        std::vector<long long> lt(k), le(k);
+        std::vector<std::pair<T, long long>> mids;
+        while (true) {
+            // 1. 枢轴取各窗口中点按窗口长度加权的中位数：不大于它的中点与不小于它的中点各占至少一半的窗口总长，
+            //    无论向哪一侧收缩，这些窗口都至少减半，每轮窗口总长至少缩小四分之一
+            mids.clear();
+            long long totalWindow = 0;
+            for (int j = 0; j < k; ++j) {
+                if (lo[j] < hi[j]) {
+                    mids.emplace_back(searchers[j].at(lo[j] + (hi[j] - lo[j]) / 2), hi[j] - lo[j]);
+                    totalWindow += hi[j] - lo[j];
+                }
+            }
+            if (mids.empty()) return lo; // 所有窗口已收缩到一点
+
+            std::sort(mids.begin(), mids.end(),
+                [](const std::pair<T, long long>& a, const std::pair<T, long long>& b) { return a.first < b.first; });
+            size_t m = 0;
+            for (long long weight = mids[0].second; weight * 2 < totalWindow; weight += mids[++m].second) {}
+            T pivot = mids[m].first;
+
+            // 2. 统计全体中 < pivot 与 <= pivot 的元素数量（窗口之前的元素都 < pivot，之后的都 > pivot）
+            long long less = 0, lessEqual = 0;
+            for (int j = 0; j < k; ++j) {
+                lt[j] = searchers[j].lowerBound(pivot, lo[j], hi[j]);
+                le[j] = searchers[j].upperBound(pivot, lt[j], hi[j]);
+                less += lt[j];
+                lessEqual += le[j];
+            }
+
+            // 3. 根据 rank 所在位置收缩窗口，或直接得到切分点
+            if (rank < less) {
+                hi = lt;
+            }
+            else if (rank > lessEqual) {
+                lo = le;
+            }
+            else {
+                // 先取所有 < pivot 的元素，再按 Run 序号分配等于 pivot 的元素
+                std::vector<long long> split(lt);
+                long long remaining = rank - less;
+                for (int j = 0; j < k && remaining > 0; ++j) {
+                    long long take = std::min(le[j] - lt[j], remaining);
+                    split[j] += take;
+                    remaining -= take;
+                }
+                return split;
+            }
+        }
+    }
 
-        // 9.  Run Ԫ
+    // 并行执行一次大的 K 路归并：按输出位置把结果划分为 partitions 段互不交叉的键区间，
+    // 每段由独立线程和文件流归并，并直接写入预先算好的输出偏移
+    RunMetadata MergeKWayPartitioned(RunFile& runFile, const std::vector<RunMetadata>& runs, int partitions) {
+
+        // 1. 为合并后的 Run 分配目录条目并预留写入区段
+        int newRunId = runFile.allocateNewRun();
+        if (newRunId == -1) {
+            throw std::runtime_error("RunFile directory is full during merge.");
+        }
+        long long totalInput = 0;
+        for (const auto& run : runs) {
+            totalInput += run.elementCount;
+        }
+        long long startOffset = runFile.reserveExtent(totalInput * (long long)sizeof(T));
+
+        // 2. 计算每个划分点在各 Run 中的切分位置
+        int k = (int)runs.size();
+        std::vector<std::vector<long long>> splits(partitions + 1);
+        {
+            std::vector<RunSearcher<T>> searchers;
+            for (const auto& run : runs) {
+                searchers.emplace_back(runFile.getStorage(), run);
+            }
+            // 划分点取整到存储对齐的元素个数，使每段的输出起点都按块对齐（startOffset 本身已对齐），
+            // 直接 I/O 下只有最后一段的末尾不足一块的部分需要读-改-写
+            long long alignment = runFile.getStorage().alignment();
+            long long alignElements = alignment % (long long)sizeof(T) == 0 ? alignment / (long long)sizeof(T) : 1;
+            splits[0].assign(k, 0);
+            for (int p = 1; p < partitions; ++p) {
+                splits[p] = coRank(searchers, totalInput * p / partitions / alignElements * alignElements);
+            }
+            splits[partitions].resize(k);
+            for (int j = 0; j < k; ++j) splits[partitions][j] = runs[j].elementCount;
+        }
+
+        // 3. 每段一个线程：截取各 Run 的子区间，写到输出中对应的偏移
+        std::vector<std::thread> pool;
+        std::vector<std::exception_ptr> errors(partitions);
+        for (int p = 0; p < partitions; ++p) {
+            pool.emplace_back([&, p]() {
+                try {
+                    std::vector<RunMetadata> parts(k);
+                    long long outRank = 0;
+                    for (int j = 0; j < k; ++j) {
+                        parts[j] = runs[j];
+                        parts[j].startOffset = runs[j].startOffset + splits[p][j] * (long long)sizeof(T);
+                        parts[j].elementCount = splits[p + 1][j] - splits[p][j];
+                        outRank += splits[p][j];
+                    }
+                    mergeRunsInto(runFile, parts, startOffset + outRank * (long long)sizeof(T));
+                }
+                catch (...) {
+                    errors[p] = std::current_exception();
+                }
+            });
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+        for (auto& e : errors) {
+            if (e) std::rethrow_exception(e);
+        }
+
+        // 4. 更新 RunFile 目录中的元数据并返回
+        runFile.updateRunMetadata(newRunId, startOffset, totalInput);
         return runFile.getRunMetadata(newRunId);
     }
 
-    // Ĭpriority_queueѣʵС
-    struct CompareRunMetadata {
-        bool operator()(const RunMetadata& a, const RunMetadata& b) {
-            // ʹ > ʵС
-            return a.elementCount > b.elementCount;
+    // 最终归并可以使用的划分数：不超过线程数，且所有划分的缓冲区总和不超过内存预算
+    int finalPartitions(const MergeStep& step) const {
+        int partitions = threadCount;
+        if (memoryBudget > 0) {
+            partitions = (int)std::min((long long)partitions, memoryBudget / stepMemory(step));
+        }
+        // 每段至少含一个输入缓冲区大小的数据，划分才有意义
+        partitions = (int)std::min((long long)partitions, step.elementCount / MERGE_INPUT_BUFFER_ELEMENTS);
+        return std::max(1, partitions);
+    }
+
+    // 执行计划中的一步归并，只有两个 Run 时退化为二路归并，partitions > 1 时按输出划分并行归并
+    RunMetadata runStep(RunFile& runFile, const std::vector<RunMetadata>& group, int partitions = 1) {
+        if (partitions > 1) {
+            return MergeKWayPartitioned(runFile, group, partitions);
+        }
+        if (group.size() == 2) {
+            return MergeInMem(runFile, group[0], group[1]);
+        }
+        return MergeKWay(runFile, group);
+    }
+
+    // 一步归并所需的缓冲区大小（以元素为单位）
+    long long stepMemory(const MergeStep& step) const {
+        long long blocks = (long long)step.inputs.size() + (step.inputs.size() > 2 ? prefetchPoolBlocks : 0);
+        return blocks * MERGE_INPUT_BUFFER_ELEMENTS + (1LL + MERGE_WRITE_BEHIND_BLOCKS) * MERGE_OUTPUT_BUFFER_ELEMENTS;
+    }
+
+    // 打印一步归并的信息
+    static void printStep(const std::vector<RunMetadata>& group) {
+        if (group.size() == 2) {
+            std::cout << "Merging (Optimal) " << group[0].elementCount << " elements and "
+                << group[1].elementCount << " elements..." << std::endl;
+        }
+        else {
+            std::cout << "Merging (Optimal) " << group.size() << " runs (K-way)..." << std::endl;
+        }
+    }
+
+    // 并发执行归并计划：互不相交的归并由线程池同时执行
+    // 一步归并的所有输入都已产生时即可开始，同时运行的归并缓冲区总和不超过内存预算
+    void executePlanParallel(const MergePlan& plan, std::vector<RunMetadata>& nodes, RunFile& runFile) {
+        int stepCount = (int)plan.steps.size();
+
+        // 1. 记录每个节点是否已产生，以及产生每个节点的步骤
+        std::vector<bool> nodeReady(nodes.size(), false);
+        for (int i = 0; i < plan.initialRunCount; ++i) nodeReady[i] = true;
+        std::vector<bool> stepStarted(stepCount, false);
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        int stepsDone = 0;
+        long long memoryInUse = 0;
+        int runningSteps = 0;
+        std::exception_ptr error;
+
+        // 2. 挑选一个可以立即开始的步骤（输入就绪且内存预算允许），没有则返回 -1
+        auto pickReadyStep = [&]() -> int {
+            for (int i = 0; i < stepCount; ++i) {
+                if (stepStarted[i]) continue;
+                bool inputsReady = true;
+                for (int input : plan.steps[i].inputs) {
+                    if (!nodeReady[input]) { inputsReady = false; break; }
+                }
+                if (!inputsReady) continue;
+                // 没有其他归并在运行时总是允许开始，避免单步超出预算时死锁
+                if (memoryBudget > 0 && runningSteps > 0 &&
+                    memoryInUse + stepMemory(plan.steps[i]) > memoryBudget) continue;
+                return i;
+            }
+            return -1;
+        };
+
+        // 3. 工作线程：反复领取就绪的步骤并执行归并
+        auto worker = [&]() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true) {
+                int stepIdx = -1;
+                cv.wait(lock, [&] {
+                    if (error || stepsDone == stepCount) return true;
+                    stepIdx = pickReadyStep();
+                    return stepIdx >= 0;
+                });
+                if (error || stepsDone == stepCount) break;
+
+                const MergeStep& step = plan.steps[stepIdx];
+                stepStarted[stepIdx] = true;
+                memoryInUse += stepMemory(step);
+                runningSteps++;
+                std::vector<RunMetadata> group;
+                for (int input : step.inputs) {
+                    group.push_back(nodes[input]);
+                }
+                printStep(group);
+                lock.unlock();
+
+                RunMetadata merged;
+                try {
+                    // 最终归并独占整个线程池，按输出划分后并行执行
+                    int partitions = (step.output == plan.finalNode) ? finalPartitions(step) : 1;
+                    merged = runStep(runFile, group, partitions);
+                }
+                catch (...) {
+                    lock.lock();
+                    if (!error) error = std::current_exception();
+                    cv.notify_all();
+                    break;
+                }
+
+                lock.lock();
+                nodes[step.output] = merged;
+                nodeReady[step.output] = true;
+                memoryInUse -= stepMemory(step);
+                runningSteps--;
+                stepsDone++;
+                cv.notify_all();
+            }
+        };
+
+        // 4. 启动线程池并等待全部完成
+        int poolSize = std::max(1, std::min(threadCount, stepCount));
+        std::vector<std::thread> pool;
+        for (int i = 0; i < poolSize; ++i) {
+            pool.emplace_back(worker);
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+
+        if (error) std::rethrow_exception(error);
+    }
+
+    // 默认priority_queue是最大堆，重载实现最小堆
+    // 堆中元素为 (长度, 节点编号)，长度相同时按编号排序，保证计划确定
+    struct ComparePlanNode {
+        bool operator()(const std::pair<long long, int>& a, const std::pair<long long, int>& b) {
+            // 使用 > 实现最小堆
+            if (a.first != b.first) return a.first > b.first;
+            return a.second > b.second;
         }
     };
 
 
+    // 把一组 Run 依次顺序复制到新区段，合成一个 Run（各组之间键范围不交叉，无需比较）
+    RunMetadata copyRunsInOrder(RunFile& runFile, const std::vector<RunMetadata>& group, const T& minKey, const T& maxKey) {
+        int newRunId = runFile.allocateNewRun();
+        if (newRunId == -1) {
+            throw std::runtime_error("RunFile directory is full during concatenation.");
+        }
+        long long totalInput = 0;
+        for (const auto& run : group) {
+            totalInput += run.elementCount;
+        }
+        long long startOffset = runFile.reserveExtent(totalInput * (long long)sizeof(T));
+
+        OutputBuffer<T> outBuf(runFile.getStorage(), startOffset, MERGE_OUTPUT_BUFFER_ELEMENTS, MERGE_WRITE_BEHIND_BLOCKS);
+        for (const auto& run : group) {
+            InputBuffer<T> inBuf = openInput(runFile, run);
+            copyRemaining(inBuf, outBuf);
+        }
+        outBuf.flush();
+
+        runFile.updateRunMetadata(newRunId, startOffset, outBuf.getElementCount(), minKey, maxKey);
+        return runFile.getRunMetadata(newRunId);
+    }
+
+    // 串联键范围互不交叉的 Run，返回替换后的 Run 列表。
+    // 按最小键从小到大处理，每个 Run 接到最大键不超过其最小键的链中最大键最大的那条上（贪心，链数最少）；
+    // 链中在文件里首尾相接的一段 Run 直接合成一个目录条目，不移动数据。
+    // 若所有 Run 串成了一条链但在文件中不连续，则顺序复制一遍，省去整个归并阶段；
+    // 其余不连续的链交给归并（单独复制会多出一趟 I/O）。没有记录键范围的 Run 原样保留
+    std::vector<RunMetadata> concatenateDisjointRuns(const std::vector<RunMetadata>& runs, RunFile& runFile) {
+        struct RangedRun {
+            T minKey;
+            T maxKey;
+            RunMetadata meta;
+        };
+        std::vector<RunMetadata> result;
+        std::vector<RangedRun> ranged;
+        for (const auto& run : runs) {
+            RangedRun r;
+            if (run.elementCount > 0 && run.getKeyRange(r.minKey, r.maxKey)) {
+                r.meta = run;
+                ranged.push_back(r);
+            }
+            else {
+                result.push_back(run);
+            }
+        }
+        if (ranged.size() < 2) {
+            return runs;
+        }
+        std::stable_sort(ranged.begin(), ranged.end(),
+            [](const RangedRun& a, const RangedRun& b) { return a.minKey < b.minKey; });
+
+        // 1. 分配链：chainByMax 以链当前的最大键为索引
+        std::vector<std::vector<int>> chains;
+        std::multimap<T, int> chainByMax;
+        for (int i = 0; i < (int)ranged.size(); ++i) {
+            int chain;
+            auto it = chainByMax.upper_bound(ranged[i].minKey);
+            if (it == chainByMax.begin()) {
+                chain = (int)chains.size();
+                chains.emplace_back();
+            }
+            else {
+                --it;
+                chain = it->second;
+                chainByMax.erase(it);
+            }
+            chains[chain].push_back(i);
+            chainByMax.insert(std::make_pair(ranged[i].maxKey, chain));
+        }
+        if (chains.size() == ranged.size()) {
+            return runs; // 没有可以串联的 Run
+        }
+
+        // 2. 每条链按文件中是否首尾相接切成若干段，每段合成一个 Run
+        bool singleChain = result.empty() && chains.size() == 1;
+        for (const auto& chain : chains) {
+            std::vector<std::pair<size_t, size_t>> segments;
+            size_t segStart = 0;
+            for (size_t k = 1; k <= chain.size(); ++k) {
+                if (k == chain.size()) {
+                    segments.push_back(std::make_pair(segStart, k));
+                    break;
+                }
+                const RunMetadata& prev = ranged[chain[k - 1]].meta;
+                if (ranged[chain[k]].meta.startOffset != prev.startOffset + prev.elementCount * (long long)sizeof(T)) {
+                    segments.push_back(std::make_pair(segStart, k));
+                    segStart = k;
+                }
+            }
+
+            const T& chainMin = ranged[chain.front()].minKey;
+            const T& chainMax = ranged[chain.back()].maxKey;
+            if (singleChain && segments.size() > 1) {
+                std::vector<RunMetadata> group;
+                for (int idx : chain) {
+                    group.push_back(ranged[idx].meta);
+                }
+                std::cout << "Copying " << group.size() << " key-disjoint runs in order..." << std::endl;
+                result.push_back(copyRunsInOrder(runFile, group, chainMin, chainMax));
+                continue;
+            }
+
+            for (const auto& seg : segments) {
+                const RangedRun& first = ranged[chain[seg.first]];
+                const RangedRun& last = ranged[chain[seg.second - 1]];
+                if (seg.second - seg.first == 1) {
+                    result.push_back(first.meta);
+                    continue;
+                }
+                long long totalElements = 0;
+                for (size_t k = seg.first; k < seg.second; ++k) {
+                    totalElements += ranged[chain[k]].meta.elementCount;
+                }
+                int newRunId = runFile.allocateNewRun();
+                if (newRunId == -1) {
+                    throw std::runtime_error("RunFile directory is full during concatenation.");
+                }
+                runFile.updateRunMetadata(newRunId, first.meta.startOffset, totalElements, first.minKey, last.maxKey);
+                result.push_back(runFile.getRunMetadata(newRunId));
+            }
+        }
+
+        if (result.size() == runs.size()) {
+            return runs; // 可以串联的链在文件中都不相接，交给归并
+        }
+        std::cout << "Concatenated key-disjoint runs: " << runs.size() << " -> " << result.size() << " runs." << std::endl;
+        return result;
+    }
+
 public:
-    // ִѹ鲢
-    RunMetadata externalMergeSort(std::vector<RunMetadata>& initialRuns, RunFile& runFile) {
+    // 构造函数：指定归并路数（2 即为原来的二路最佳归并树）、并发线程数、缓冲区内存预算、
+    // K 路归并时共享的预测式预读块池大小，以及是否用内存映射读取输入 Run（开启后不使用预读）
+    Merger(int fanIn = MERGE_DEFAULT_FAN_IN, int threads = 1, long long memElements = 0, int prefetchPool = 0, bool mapped = false)
+        : maxFanIn(fanIn), threadCount(threads), memoryBudget(memElements), prefetchPoolBlocks(prefetchPool), mappedInput(mapped) {
+        if (fanIn < 2) throw std::invalid_argument("Merge fan-in must be >= 2");
+        if (threads < 1) throw std::invalid_argument("Merge thread count must be >= 1");
+    }
 
-        // 1. ʼС (Priority Queue)
-        std::priority_queue<RunMetadata, std::vector<RunMetadata>, CompareRunMetadata> mergeHeap;
+    // 根据内存预算计算能同时容纳的最大归并路数（需留出输出缓冲区（含后写块）与共享预读块池）
+    static int fanInForMemory(long long memElements, int prefetchPool = 0) {
+        long long fanIn = memElements / MERGE_INPUT_BUFFER_ELEMENTS - 1 - MERGE_WRITE_BEHIND_BLOCKS - prefetchPool;
+        return (int)std::max(2LL, std::min(fanIn, (long long)std::numeric_limits<int>::max()));
+    }
 
-        // 2. гʼ鲢ηС
-        for (const auto& run : initialRuns) {
-            mergeHeap.push(run);
+    // 计算 K 路最佳归并树（Huffman 树）计划，不进行任何 I/O
+    // 补充 (K-1) - (N-1) mod (K-1) 个长度为 0 的虚段，使第一次归并只合并 (N-1) mod (K-1) + 1 个最短的 Run，
+    // 之后每次都是满 K 路归并，从而总读写量最小
+    MergePlan planMerge(const std::vector<RunMetadata>& initialRuns) const {
+        int n = (int)initialRuns.size();
+        if (n == 0) {
+            throw std::invalid_argument("No runs to merge.");
         }
 
-        // 3. ѭֱֻʣһ Run
-        while (mergeHeap.size() > 1) {
+        MergePlan plan;
+        plan.initialRunCount = n;
+        plan.fanIn = std::max(2, std::min(maxFanIn, n));
+        plan.dummyRunCount = (n > 1) ? ((plan.fanIn - 1) - (n - 1) % (plan.fanIn - 1)) % (plan.fanIn - 1) : 0;
+        plan.finalNode = 0;
+        plan.totalElementsMoved = 0;
+
+        // 1. 初始化最小堆，放入所有初始 Run 与虚段（虚段编号为 -1）
+        std::priority_queue<std::pair<long long, int>, std::vector<std::pair<long long, int>>, ComparePlanNode> planHeap;
+        for (int i = 0; i < n; ++i) {
+            planHeap.push(std::make_pair(initialRuns[i].elementCount, i));
+        }
+        for (int i = 0; i < plan.dummyRunCount; ++i) {
+            planHeap.push(std::make_pair(0LL, -1));
+        }
 
-            // 3a. ȡС Runs
-            RunMetadata runA = mergeHeap.top();
-            mergeHeap.pop();
-            RunMetadata runB = mergeHeap.top();
-            mergeHeap.pop();
+        // 2. 每次取出 K 个最短的节点合并，直到只剩一个
+        int nextNode = n;
+        while (planHeap.size() > 1) {
+            MergeStep step;
+            step.elementCount = 0;
+            for (int i = 0; i < plan.fanIn && !planHeap.empty(); ++i) {
+                std::pair<long long, int> node = planHeap.top();
+                planHeap.pop();
+                if (node.second >= 0) {
+                    step.inputs.push_back(node.second);
+                    step.elementCount += node.first;
+                }
+            }
+            step.output = nextNode++;
+            plan.totalElementsMoved += 2 * step.elementCount;
+            plan.steps.push_back(step);
+            planHeap.push(std::make_pair(step.elementCount, step.output));
+        }
 
-            // 3b. ϲ
-            std::cout << "Merging (Optimal) " << runA.elementCount << " elements and "
-                << runB.elementCount << " elements..." << std::endl;
-            RunMetadata mergedRun = MergeInMem(runFile, runA, runB);
+        // 3. 堆中剩下的节点就是最终结果
+        plan.finalNode = planHeap.top().second;
+        return plan;
+    }
 
-            // 3c. ϲ Run Żض
-            mergeHeap.push(mergedRun);
+    // 打印归并计划与预计的 I/O 量
+    void printPlan(const MergePlan& plan) const {
+        std::cout << "Merge plan: " << plan.initialRunCount << " runs, fan-in " << plan.fanIn
+            << ", " << plan.dummyRunCount << " dummy runs, " << plan.steps.size() << " merge steps." << std::endl;
+        for (const auto& step : plan.steps) {
+            std::cout << "  - Step -> node " << step.output << ": merge " << step.inputs.size()
+                << " runs, " << step.elementCount << " elements" << std::endl;
         }
+        std::cout << "Predicted merge I/O: " << plan.totalElementsMoved << " elements ("
+            << plan.totalElementsMoved * (long long)sizeof(T) << " bytes)." << std::endl;
+    }
 
-        // 4. ʣµһ Run ս
+    // 按计划执行归并，返回最终 Run 的元数据
+    RunMetadata executePlan(const MergePlan& plan, const std::vector<RunMetadata>& initialRuns, RunFile& runFile) {
+
+        // 1. 节点表：前 N 个为初始 Run，其余由归并步骤依次填充
+        std::vector<RunMetadata> nodes(initialRuns.begin(), initialRuns.end());
+        nodes.resize(plan.initialRunCount + plan.steps.size());
+
+        // 2. 单线程时依次执行每一步归并，否则交给线程池并发执行
+        if (threadCount <= 1) {
+            for (const auto& step : plan.steps) {
+                std::vector<RunMetadata> group;
+                for (int input : step.inputs) {
+                    group.push_back(nodes[input]);
+                }
+                printStep(group);
+                nodes[step.output] = runStep(runFile, group);
+            }
+        }
+        else {
+            executePlanParallel(plan, nodes, runFile);
+        }
+
+        // 3. 最终节点就是排好序的 Run
         std::cout << "Optimal external merge sort finished." << std::endl;
-        return mergeHeap.top();
+        return nodes[plan.finalNode];
+    }
+
+    // 执行最佳归并树的外排序：先串联键范围互不交叉的 Run，再计划、执行
+    RunMetadata externalMergeSort(std::vector<RunMetadata>& initialRuns, RunFile& runFile) {
+        std::vector<RunMetadata> runs = concatenateDisjointRuns(initialRuns, runFile);
+        MergePlan plan = planMerge(runs);
+        printPlan(plan);
+        return executePlan(plan, runs, runFile);
     }
 };
 
@@ -0,0 +1,158 @@
+#ifndef PRESORTEDNESS_H
+#define PRESORTEDNESS_H
+
+#include "RadixSort.h"
+#include "MergeKernel.h"
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstddef>
+
+// 自然升序段至少这么长才直接使用（不再重新排序或经过败者树），更短的段按无序数据处理
+#ifndef RG_NATURAL_RUN_MIN
+#define RG_NATURAL_RUN_MIN 4096
+#endif
+
+// 输入的预排序程度：按输入顺序统计相邻元素的逆序次数与自然升序段
+struct PresortStats {
+    long long elements = 0;     // 已扫描的元素数量
+    long long descents = 0;     // 相邻两个元素中后者小于前者的次数
+    long long longestRun = 0;   // 最长的自然升序段长度
+
+    // 自然升序段的数量（逆序次数 + 1）
+    long long naturalRuns() const {
+        return elements > 0 ? descents + 1 : 0;
+    }
+
+    // 相邻元素中有序的比例，1 表示整个输入已经有序
+    double sortedFraction() const {
+        return elements > 1 ? 1.0 - (double)descents / (double)(elements - 1) : 1.0;
+    }
+
+    // 自然升序段的平均长度
+    double averageRunLength() const {
+        return elements > 0 ? (double)elements / (double)naturalRuns() : 0.0;
+    }
+
+    void print(std::ostream& os) const {
+        os << "Presortedness: " << sortedFraction() * 100.0 << "% of adjacent pairs in order, "
+            << naturalRuns() << " natural runs (average " << averageRunLength()
+            << ", longest " << longestRun << " elements)." << std::endl;
+    }
+};
+
+// 按块依次扫描输入并累计 PresortStats，相邻两块之间的边界也计入统计
+template <typename T>
+class PresortScanner {
+private:
+    PresortStats stats;
+    T last = T();             // 上一块的最后一个元素
+    long long currentRun = 0; // 当前自然升序段已有的长度
+
+public:
+    // 扫描下一块数据，返回块内（含与上一块的边界）的逆序次数。循环中不含分支，随机数据也不会频繁预测失败
+    long long scan(const T* data, size_t n) {
+        if (n == 0) return 0;
+        long long descents = 0;
+        long long run = currentRun;
+        long long longest = stats.longestRun;
+        T prev = stats.elements > 0 ? last : data[0];
+        for (size_t i = 0; i < n; ++i) {
+            bool descent = data[i] < prev;
+            descents += descent;
+            run = descent ? 1 : run + 1;
+            longest = std::max(longest, run);
+            prev = data[i];
+        }
+        last = prev;
+        currentRun = run;
+        stats.elements += (long long)n;
+        stats.descents += descents;
+        stats.longestRun = longest;
+        return descents;
+    }
+
+    const PresortStats& getStats() const {
+        return stats;
+    }
+
+    void reset() {
+        stats = PresortStats();
+        currentRun = 0;
+    }
+};
+
+// 策略选择：逆序次数不超过元素数的四分之一时数据可能含有较长的自然升序段，值得用 sortAdaptive 找出它们；
+// 否则（例如随机数据约有一半相邻对逆序）直接整体排序，省去逐段查找
+inline bool preferNaturalRuns(long long descents, long long elements) {
+    return descents * 4 <= elements;
+}
+
+// 自适应排序 [first, last)：长度不少于 RG_NATURAL_RUN_MIN 的自然升序段保持原样，
+// 夹在它们之间的短段合并成无序区间用 sortKeys 排序，再把所有有序区间逐趟两两归并
+// （mergeArrays 的倍增查找使首尾相接的区间接近顺序复制）。
+// 长自然段覆盖不到一半数据时直接整体排序。scratch 至少要有 last - first 个元素的空间
+template <typename T>
+void sortAdaptive(T* first, T* last, T* scratch) {
+    size_t n = (size_t)(last - first);
+    if (n < 2) return;
+
+    // 1. 找出有序区间：长自然段单独成为一个区间，相邻的短段合并成一个待排序区间
+    std::vector<size_t> bounds(1, 0);
+    std::vector<bool> needsSort;
+    size_t covered = 0;
+    size_t runStart = 0;
+    for (size_t i = 1; i <= n; ++i) {
+        if (i < n && !(first[i] < first[i - 1])) continue;
+        bool longRun = i - runStart >= (size_t)RG_NATURAL_RUN_MIN;
+        if (longRun) {
+            covered += i - runStart;
+            if (bounds.back() < runStart) {
+                bounds.push_back(runStart);
+                needsSort.push_back(true);
+            }
+            bounds.push_back(i);
+            needsSort.push_back(false);
+        }
+        runStart = i;
+    }
+    if (bounds.back() < n) {
+        bounds.push_back(n);
+        needsSort.push_back(true);
+    }
+    if (covered * 2 < n) {
+        sortKeys(first, last, scratch);
+        return;
+    }
+
+    for (size_t s = 0; s + 1 < bounds.size(); ++s) {
+        if (needsSort[s]) {
+            sortKeys(first + bounds[s], first + bounds[s + 1], scratch + bounds[s]);
+        }
+    }
+
+    // 2. 逐趟两两归并相邻区间，在 first 与 scratch 之间来回
+    T* src = first;
+    T* dst = scratch;
+    size_t checkInterval = MERGE_GALLOP_INTERVAL;
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged;
+        for (size_t p = 0; p + 1 < bounds.size(); p += 2) {
+            merged.push_back(bounds[p]);
+            if (p + 2 >= bounds.size()) {
+                std::copy(src + bounds[p], src + bounds[p + 1], dst + bounds[p]);
+                continue;
+            }
+            mergeArrays(src + bounds[p], bounds[p + 1] - bounds[p], src + bounds[p + 1], bounds[p + 2] - bounds[p + 1],
+                dst + bounds[p], checkInterval);
+        }
+        merged.push_back(n);
+        bounds.swap(merged);
+        std::swap(src, dst);
+    }
+    if (src != first) {
+        std::copy(src, src + n, first);
+    }
+}
+
+#endif // PRESORTEDNESS_H
\ No newline at end of file
@@ -6,22 +6,84 @@
 #include <vector>
 #include <string>
 #include <stdexcept>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
 
-// 鲢Ԫ
+#include "StorageBackend.h"
+
+// 元数据中为最小 / 最大键各预留的字节数，键类型更大（或不可按字节复制）时不记录键范围
+#ifndef RUN_KEY_BYTES
+#define RUN_KEY_BYTES 16
+#endif
+
+// 归并段元数据
 struct RunMetadata {
-    long long startOffset;   // ù鲢ļеʼֽƫ
-    long long elementCount;  // ù鲢ΰԪ
-    bool isUsed;             // ù鲢Ƿڱʹ
+    long long startOffset;   // 该归并段在文件中的起始字节偏移
+    long long elementCount;  // 该归并段包含的元素数量
+    bool isUsed;             // 该归并段是否正在被使用
+    bool hasKeyRange;        // minKey / maxKey 是否有效
+    unsigned char minKey[RUN_KEY_BYTES]; // 该归并段的最小键（即第一个元素，按字节保存）
+    unsigned char maxKey[RUN_KEY_BYTES]; // 该归并段的最大键（即最后一个元素）
+
+    // 默认构造函数
+    RunMetadata() : startOffset(0), elementCount(0), isUsed(false), hasKeyRange(false) {
+        memset(minKey, 0, sizeof(minKey));
+        memset(maxKey, 0, sizeof(maxKey));
+    }
+
+    // 键类型 T 能否保存在元数据中
+    template <typename T>
+    struct KeyStorable {
+        static const bool value = sizeof(T) <= RUN_KEY_BYTES && std::is_trivially_copyable<T>::value;
+    };
+
+    // 记录键范围（T 不能保存时忽略）
+    template <typename T>
+    void setKeyRange(const T& lo, const T& hi) {
+        storeKeyRange(lo, hi, std::integral_constant<bool, KeyStorable<T>::value>());
+    }
+
+    // 读取键范围，未记录时返回 false
+    template <typename T>
+    bool getKeyRange(T& lo, T& hi) const {
+        return loadKeyRange(lo, hi, std::integral_constant<bool, KeyStorable<T>::value>());
+    }
+
+private:
+    template <typename T>
+    void storeKeyRange(const T& lo, const T& hi, std::true_type) {
+        memcpy(minKey, &lo, sizeof(T));
+        memcpy(maxKey, &hi, sizeof(T));
+        hasKeyRange = true;
+    }
+
+    template <typename T>
+    void storeKeyRange(const T&, const T&, std::false_type) {
+        hasKeyRange = false;
+    }
+
+    template <typename T>
+    bool loadKeyRange(T& lo, T& hi, std::true_type) const {
+        if (!hasKeyRange) return false;
+        memcpy(&lo, minKey, sizeof(T));
+        memcpy(&hi, maxKey, sizeof(T));
+        return true;
+    }
 
-    // ĬϹ캯
-    RunMetadata() : startOffset(0), elementCount(0), isUsed(false) {}
+    template <typename T>
+    bool loadKeyRange(T&, T&, std::false_type) const {
+        return false;
+    }
 };
 
-// 鲢ļͷ
+// 归并段文件头
 struct RunFileHeader {
-    char magic[4];       // ļʶ "RUNS"
-    int maxRuns;         // Ŀ¼ܴ洢 Run 
-    int currentRunCount; // ļеǰԾ Run 
+    char magic[4];       // 文件标识，例如 "RUNS"
+    int maxRuns;         // 目录区能存储的最大 Run 数量
+    int currentRunCount; // 文件中当前活跃的 Run 数量
 
     RunFileHeader(int max_runs = 0)
         : maxRuns(max_runs), currentRunCount(0) {
@@ -29,45 +91,53 @@ struct RunFileHeader {
     }
 };
 
-// 鲢ļ
+// 归并文件类
 class RunFile {
 private:
-    std::fstream file;      // ļ
+    std::unique_ptr<StorageBackend> storage; // 存储后端（按绝对偏移读写，可被多个线程同时使用）
     std::string filename;
     RunFileHeader header;
-    std::vector<RunMetadata> directory; // Ŀ¼ڴ渱
+    std::vector<RunMetadata> directory; // 目录区的内存副本
+    long long reservedEnd;  // 已预留区段的末尾（并发写入时文件实际长度可能尚未到达）
+    std::mutex mtx;         // 保护目录区与预留偏移，允许多个线程同时申请 Run
 
-    // ڴеĵԪĿдش
+    // 将内存中的单个元数据条目写回磁盘
     void writeMetadataToDisk(int runId) {
-        if (!file.is_open() || runId < 0 || runId >= header.maxRuns) {
+        if (!storage || runId < 0 || runId >= header.maxRuns) {
             return;
         }
-        // λԪļеλ
+        // 计算该元数据在文件中的位置并写入
         long long diskOffset = sizeof(RunFileHeader) + (long long)runId * sizeof(RunMetadata);
-        file.seekp(diskOffset);
-        // д
-        file.write(reinterpret_cast<const char*>(&directory[runId]), sizeof(RunMetadata));
+        storage->writeAt(&directory[runId], sizeof(RunMetadata), diskOffset);
+    }
+
+    // 新 Run 的起始偏移：取文件末尾与已预留区段末尾中较大者（跳过尚未写完的区段），
+    // 再向上对齐到存储后端要求的粒度，直接 I/O 时每个 Run 都从块边界开始，不与其他 Run 共用一块
+    long long nextRunOffset() {
+        long long start = std::max(storage->size(), reservedEnd);
+        long long align = storage->alignment();
+        return (start + align - 1) / align * align;
     }
 
 public:
-    RunFile(const std::string& fname) : filename(fname) {}
+    RunFile(const std::string& fname) : filename(fname), reservedEnd(0) {}
 
     ~RunFile() {
         close();
     }
 
-    // ʼ Run ļ
+    // 创建并初始化 Run 文件
     bool create(int maxRuns = 1000) {
         header = RunFileHeader(maxRuns);
 
-        file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
         if (!file.is_open()) return false;
 
-        // дļͷ
+        // 写入文件头
         file.write(reinterpret_cast<const char*>(&header), sizeof(RunFileHeader));
 
-        // дյĿ¼
-        directory.assign(maxRuns, RunMetadata()); // յԪ
+        // 写入空的目录区
+        directory.assign(maxRuns, RunMetadata()); // 创建空的元数据
         for (int i = 0; i < maxRuns; ++i) {
             file.write(reinterpret_cast<const char*>(&directory[i]), sizeof(RunMetadata));
         }
@@ -76,85 +146,128 @@ public:
         return true;
     }
 
-    // һѴڵ Run ļ
-    bool open() {
-        // Զдģʽ
-        file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
-        if (!file.is_open()) return false;
+    // 打开一个已存在的 Run 文件，backend 为空时使用默认的 pread/pwrite 后端
+    bool open(std::unique_ptr<StorageBackend> backend = nullptr) {
+        storage = backend ? std::move(backend) : std::unique_ptr<StorageBackend>(new PositionalStorageBackend());
+        // 以读写模式打开
+        if (!storage->open(filename)) {
+            storage.reset();
+            return false;
+        }
 
-        // ȡļͷ
-        file.read(reinterpret_cast<char*>(&header), sizeof(RunFileHeader));
+        // 读取文件头
+        try {
+            storage->readAt(&header, sizeof(RunFileHeader), 0);
+        }
+        catch (const std::exception&) {
+            storage.reset();
+            return false;
+        }
         if (std::string(header.magic, 4) != "RUNS") {
-            file.close();
-            return false; // Ч Run ļ
+            storage.reset();
+            return false; // 不是有效的 Run 文件
         }
 
-        // ȡĿ¼ڴ
+        // 读取整个目录区到内存
         directory.resize(header.maxRuns);
-        for (int i = 0; i < header.maxRuns; ++i) {
-            file.read(reinterpret_cast<char*>(&directory[i]), sizeof(RunMetadata));
-        }
+        storage->readAt(directory.data(), (long long)header.maxRuns * sizeof(RunMetadata), sizeof(RunFileHeader));
 
-        // ļ
+        // 保持文件打开
         return true;
     }
 
-    // رļ
+    // 关闭文件
     void close() {
-        if (file.is_open()) {
-            file.flush();
-            file.close();
+        if (storage) {
+            storage->close();
+            storage.reset();
         }
     }
 
-    // Ŀ¼һµ Run Ŀ
+    // 在目录区分配一个新的 Run 条目
     int allocateNewRun() {
+        std::lock_guard<std::mutex> lock(mtx);
         for (int i = 0; i < header.maxRuns; ++i) {
             if (!directory[i].isUsed) {
                 directory[i].isUsed = true;
                 directory[i].startOffset = 0;
                 directory[i].elementCount = 0;
+                directory[i].hasKeyRange = false;
 
-                // Ŀдش
+                // 将这个新条目写回磁盘
                 writeMetadataToDisk(i);
 
                 header.currentRunCount++;
-                return i; //  Run ID
+                return i; // 返回 Run ID
             }
         }
-        return -1; // Ŀ¼
+        return -1; // 目录已满
     }
 
-    // һ Run Ԫ
+    // 更新一个 Run 的元数据
     void updateRunMetadata(int runId, long long startOffset, long long elementCount) {
         if (runId < 0 || runId >= header.maxRuns) {
             throw std::out_of_range("Invalid runId in updateRunMetadata.");
         }
+        std::lock_guard<std::mutex> lock(mtx);
+        directory[runId].startOffset = startOffset;
+        directory[runId].elementCount = elementCount;
+
+        // 将更新写回磁盘
+        writeMetadataToDisk(runId);
+    }
+
+    // 更新一个 Run 的元数据并记录其键范围（Run 内有序，minKey / maxKey 即首尾元素）
+    template <typename T>
+    void updateRunMetadata(int runId, long long startOffset, long long elementCount, const T& minKey, const T& maxKey) {
+        if (runId < 0 || runId >= header.maxRuns) {
+            throw std::out_of_range("Invalid runId in updateRunMetadata.");
+        }
+        std::lock_guard<std::mutex> lock(mtx);
         directory[runId].startOffset = startOffset;
         directory[runId].elementCount = elementCount;
+        directory[runId].setKeyRange(minKey, maxKey);
 
-        // дش
+        // 将更新写回磁盘
         writeMetadataToDisk(runId);
     }
 
-    // ȡָ Run Ԫ
+    // 获取指定 Run 的元数据
     RunMetadata getRunMetadata(int runId) {
         if (runId < 0 || runId >= header.maxRuns) {
             throw std::out_of_range("Invalid runId in getRunMetadata.");
         }
+        std::lock_guard<std::mutex> lock(mtx);
         return directory[runId];
     }
 
-    // ȡʼ/׷ƫ
+    // 获取数据区的起始/追加偏移
     long long getAppendOffset() {
-        // λļĩβ
-        file.seekp(0, std::ios::end);
-        return file.tellp();
+        std::lock_guard<std::mutex> lock(mtx);
+        return nextRunOffset();
     }
 
-    // ¶ļ
-    std::fstream& getStream() {
-        return file;
+    // 声明数据区已使用到 end（数据可能仍在后台写入），之后分配的偏移都不早于它
+    void markUsedThrough(long long end) {
+        std::lock_guard<std::mutex> lock(mtx);
+        reservedEnd = std::max(reservedEnd, end);
+    }
+
+    // 在数据区末尾预留指定字节数的区段，返回其起始偏移
+    // 预留后各线程在各自的区段内写入，互不重叠
+    long long reserveExtent(long long bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        long long start = nextRunOffset();
+        reservedEnd = start + bytes;
+        return start;
+    }
+
+    // 暴露存储后端，所有 Run 数据都通过它按偏移读写
+    StorageBackend& getStorage() {
+        if (!storage) {
+            throw std::runtime_error("Run file is not open.");
+        }
+        return *storage;
     }
 };
 
@@ -3,51 +3,155 @@
 
 #include <vector>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
 #include <fstream>
 #include <string>
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <exception>
 
 #include "RunFile.h"
 #include "LoserTree.h"
+#include "Presortedness.h"
+#include "RadixSort.h"
+#include "SpscRing.h"
 
+// 每个输入 / 输出块的元素个数（按内存预算划分时为块大小的上限）
 #ifndef RG_BUFFER_SIZE
-#define RG_BUFFER_SIZE (1024 * 1024)
+#define RG_BUFFER_SIZE (512 * 1024)
 #endif
 
+// 按内存预算划分时，输入 / 输出流水线的块占预算的百分比，其余留给置换选择的工作区
+#ifndef RG_STAGING_PERCENT
+#define RG_STAGING_PERCENT 25
+#endif
+
+// 按内存预算划分时块的最小字节数：块太小时先减少环形队列深度（至少 2，即双缓冲）
+#ifndef RG_MIN_BLOCK_BYTES
+#define RG_MIN_BLOCK_BYTES (64 * 1024)
+#endif
+
+// 输入与输出环形队列各有多少个块：读线程最多领先 Compute 线程这么多块，写线程最多落后这么多块
+#ifndef RG_RING_DEPTH
+#define RG_RING_DEPTH 4
+#endif
+
+// 批量置换选择的批大小（元素个数）：输入每攒够一批就在缓存内整体排序成一个小段（mini-run），
+// 败者树只在各小段的队首之间比较。设为 0 或内存预算不足两批时退回逐元素的置换选择
+#ifndef RG_BATCH_SIZE
+#define RG_BATCH_SIZE 16384
+#endif
+
+// RunGenerator 的内存划分：置换选择的工作区与输入 / 输出流水线的块
+struct RunGeneratorLayout {
+    int treeElements = 0;       // 置换选择工作区能容纳的元素个数（即 Run 长度约为它的 2 倍）
+    int blockElements = 0;      // 每个输入 / 输出块的元素个数
+    int ringDepth = 0;          // 输入与输出环形队列各自的块数
+    int batchElements = 0;      // 批量置换选择的批大小，0 表示逐元素模式
+    long long totalElements = 0; // 以上各部分合计占用的内存（按元素个数计）
+
+    void print(std::ostream& os) const {
+        os << "Run generator layout: " << treeElements << " elements in selection ("
+            << (batchElements > 0 ? "batches of " + std::to_string(batchElements) : std::string("per element"))
+            << "), " << ringDepth << " x 2 blocks of " << blockElements << " elements for I/O, "
+            << totalElements << " elements in total." << std::endl;
+    }
+};
+
 template <typename T>
 class RunGenerator {
 public:
-    // 캯ʼԴ߳ͬ״̬
-    RunGenerator(int memSizeForLoserTree, int bufferSize = RG_BUFFER_SIZE)
+    // 按内存预算（元素个数）划分工作区与流水线：
+    //      - 约 RG_STAGING_PERCENT% 给输入 / 输出两个环形队列，每个队列 ringDepth 块；
+    //        块小于 RG_MIN_BLOCK_BYTES 时先减少深度，块大小不超过 RG_BUFFER_SIZE，并按 4KB 取整
+    //      - 其余给置换选择：批量模式下各小段槽位合计可占到工作区的 2 倍，另需一批的排序辅助缓冲区
+    //        （败者树只有约 2K / 批大小个叶子，建树的临时数组可以忽略）；
+    //        放不下两批时改用逐元素模式，取 selectionBytes 放得下的最多叶子数，
+    //        即计入败者树节点数组的实际大小与建树时的临时数组
+    //      不计每个线程的栈等小开销
+    static RunGeneratorLayout layoutForMemory(long long memElements, int ringDepth = RG_RING_DEPTH,
+        int batchElements = RG_BATCH_SIZE) {
+        if (memElements < 1) throw std::invalid_argument("Run generator memory budget must be >= 1 element");
+        RunGeneratorLayout layout;
+
+        // 1. 流水线的块
+        long long staging = memElements * RG_STAGING_PERCENT / 100;
+        long long minBlock = std::max<long long>(1, RG_MIN_BLOCK_BYTES / (long long)sizeof(T));
+        long long pageElements = std::max<long long>(1, 4096 / (long long)sizeof(T));
+        int depth = std::max(2, ringDepth);
+        while (depth > 2 && staging / (2 * depth) < minBlock) --depth;
+        long long block = std::min<long long>(staging / (2 * depth), RG_BUFFER_SIZE);
+        if (block >= pageElements) block = block / pageElements * pageElements;
+        block = std::max<long long>(1, block);
+        layout.ringDepth = depth;
+        layout.blockElements = (int)block;
+
+        // 2. 置换选择的工作区
+        long long selection = std::max<long long>(1, memElements - 2 * depth * block);
+        long long batchedTree = batchElements > 1 ?
+            std::min<long long>((selection - batchElements) / 2, std::numeric_limits<int>::max()) / batchElements * batchElements : 0;
+        if (batchElements > 1 && effectiveBatchSize((int)batchedTree, batchElements) > 0) {
+            // 工作区取整到整批，槽位合计恰好是它的 2 倍
+            layout.batchElements = batchElements;
+            layout.treeElements = (int)batchedTree;
+            layout.totalElements = (long long)batchSlotCount(layout.treeElements, batchElements) * batchElements + batchElements;
+        }
+        else {
+            // 占用随叶子数单调不减，二分查找放得下的最多叶子数（至少 1 个）
+            long long bytes = selection * (long long)sizeof(T);
+            long long lo = 1;
+            long long hi = std::min<long long>(std::max<long long>(1, bytes / transientBytesPerLeaf()), std::numeric_limits<int>::max());
+            while (lo < hi) {
+                long long mid = lo + (hi - lo + 1) / 2;
+                if (selectionBytes((int)mid) <= bytes) lo = mid;
+                else hi = mid - 1;
+            }
+            layout.batchElements = 0;
+            layout.treeElements = (int)lo;
+            layout.totalElements = (selectionBytes(layout.treeElements) + (long long)sizeof(T) - 1) / (long long)sizeof(T);
+        }
+        layout.totalElements += 2LL * depth * block;
+        return layout;
+    }
+
+    // 逐元素模式下建树时每个叶子的临时字节数：填充树的元素数组（初始填充的 T 或
+    // passThroughNaturalRun 的 RunNode，取较大者）与 LoserTree 建树用的数组，与节点数组同时存在
+    static long long transientBytesPerLeaf() {
+        return (long long)(LoserTree<T>::buildBytesPerLeaf() + std::max(sizeof(T), sizeof(RunNode<T>)));
+    }
+
+    // 逐元素模式下 leaves 个叶子的峰值字节数：败者树节点数组的实际大小加上建树时的临时数组
+    static long long selectionBytes(int leaves) {
+        return (long long)LoserTree<T>::nodeBytes(leaves) + (long long)leaves * transientBytesPerLeaf();
+    }
+
+    // 按 layoutForMemory 的划分构造
+    explicit RunGenerator(const RunGeneratorLayout& layout)
+        : RunGenerator(layout.treeElements, layout.blockElements, layout.batchElements, layout.ringDepth) {}
+
+    // 构造函数：初始化资源
+    // batchElements 为批量置换选择的批大小，0 表示逐元素的置换选择；ringDepth 为输入 / 输出环形队列的块数
+    RunGenerator(int memSizeForLoserTree, int bufferSize = RG_BUFFER_SIZE, int batchElements = RG_BATCH_SIZE,
+        int ringDepth = RG_RING_DEPTH)
         : K(memSizeForLoserTree),
         bufSize(bufferSize),
-        // ° LoserTree 캯ֻܴСڲڱ
-        loserTree(memSizeForLoserTree),
-        stop_threads(false),
-        standby_input_ready(false),
-        standby_output_busy(false),
-        input_eof(false)
+        batchSize(effectiveBatchSize(memSizeForLoserTree, batchElements)),
+        // 新版 LoserTree 构造函数只接受大小，内部处理哨兵；批量模式下叶子是小段而不是元素
+        loserTree(batchSize > 0 ? batchSlotCount(memSizeForLoserTree, batchSize) : memSizeForLoserTree),
+        inputRing(ringDepth),
+        outputRing(ringDepth),
+        stop_threads(false)
     {
-        inBufA.resize(bufSize); inBufB.resize(bufSize);
-        outBufA.resize(bufSize); outBufB.resize(bufSize);
-
-        activeIn = &inBufA; standbyIn = &inBufB;
-        activeOut = &outBufA; standbyOut = &outBufB;
-
-        activeIn->resize(0); // ʼΪգһζȡ
-        activeOut->clear();
+        if (bufferSize < 1) throw std::invalid_argument("Run generator block size must be >= 1");
+        for (size_t i = 0; i < inputRing.depth(); ++i) {
+            inputRing.at(i).reserve(bufSize);
+            outputRing.at(i).data.reserve(bufSize);
+        }
     }
 
     ~RunGenerator() {
-        stop_threads = true;
-        cv_input.notify_all();
-        cv_output.notify_all();
-        if (inputThread.joinable()) inputThread.join();
-        if (outputThread.joinable()) outputThread.join();
+        stopThreads();
     }
 
     std::vector<RunMetadata> generateRuns(const std::string& inputFilename, RunFile& runFile) {
@@ -55,42 +159,72 @@ public:
         inputFile.open(inputFilename, std::ios::binary);
         if (!inputFile) throw std::runtime_error("Cannot open input file");
 
-        currentRunId = runFile.allocateNewRun();
-        currentRunStartOffset = runFile.getAppendOffset();
-        totalElementsInRun = 0;
-        generatedRuns.clear();
-
-        inputThread = std::thread(&RunGenerator::inputWorker, this);
-        outputThread = std::thread(&RunGenerator::outputWorker, this);
-
-        computeWorker();
+        try {
+            currentRunId = runFile.allocateNewRun();
+            currentRunStartOffset = runFile.getAppendOffset();
+            totalElementsInRun = 0;
+            runHasKeys = false;
+            generatedRuns.clear();
+            presortScanner.reset();
+
+            stop_threads = false;
+            outputError = nullptr;
+            inputRing.reset();
+            outputRing.reset();
+            activeIn = nullptr;
+            activeInIdx = 0;
+            activeOut = outputRing.acquireWrite();
+            activeOut->data.clear();
+
+            inputThread = std::thread(&RunGenerator::inputWorker, this);
+            outputThread = std::thread(&RunGenerator::outputWorker, this);
+
+            computeWorker();
+        }
+        catch (...) {
+            // Compute 线程出错：停止另外两个线程后再交给调用者
+            stopThreads();
+            inputFile.close();
+            throw;
+        }
 
+        // 所有块都已写出后 outputWorker 才退出；写盘出错时在这里交给调用者
+        stopThreads();
         inputFile.close();
+        if (outputError) {
+            std::rethrow_exception(outputError);
+        }
+        presortScanner.getStats().print(std::cout);
         return generatedRuns;
     }
 
+    // 最近一次 generateRuns 扫描到的输入预排序程度
+    const PresortStats& getPresortStats() const {
+        return presortScanner.getStats();
+    }
+
 private:
     const int K;
     const int bufSize;
+    const int batchSize;        // 批量置换选择的批大小，0 表示逐元素模式
     LoserTree<T> loserTree;
 
-    // Buffers
-    std::vector<T> inBufA, inBufB;
-    std::vector<T> outBufA, outBufB;
-    std::vector<T>* activeIn;
-    std::vector<T>* standbyIn;
-    std::vector<T>* activeOut;
-    std::vector<T>* standbyOut;
-
-    int activeInIdx = 0;
-    // activeOutIdx ʵϲҪΪԱάΪ push_back logic бڼ
-
-    std::mutex mtx;
-    std::condition_variable cv_input, cv_output, cv_compute;
-    bool standby_input_ready;
-    bool standby_output_busy;
-    bool input_eof;
+    // 输出块描述符：数据及其在 RunFile 中的写入偏移（由 Compute 线程在发布时确定）
+    struct OutputBlock {
+        IoBlock<T> data;
+        long long offset = 0;
+    };
+
+    // 三个线程之间只通过两个单生产者 / 单消费者环形队列交接数据块：
+    //      inputRing：inputWorker 读满一块后发布，Compute 线程用完后归还
+    //      outputRing：Compute 线程写满一块后发布，outputWorker 写盘后归还
+    SpscRing<std::vector<T>> inputRing;
+    SpscRing<OutputBlock> outputRing;
+    std::vector<T>* activeIn = nullptr;   // Compute 线程正在读取的输入块（nullptr 表示尚未取得）
+    size_t activeInIdx = 0;
+    OutputBlock* activeOut = nullptr;     // Compute 线程正在填写的输出块
     std::atomic<bool> stop_threads;
+    std::exception_ptr outputError;       // outputWorker 写盘出错时记录的异常，由 generateRuns 重新抛出
 
     std::thread inputThread;
     std::thread outputThread;
@@ -98,210 +232,516 @@ private:
     std::ifstream inputFile;
     RunFile* runFilePtr;
     long long currentRunStartOffset;
-    long long totalElementsInRun;
+    long long totalElementsInRun;   // 当前 Run 已发布到 outputRing 的元素个数
     int currentRunId;
+    T runMinKey, runMaxKey;     // 当前 Run 输出的第一个与最后一个元素（即键范围）
+    bool runHasKeys;            // 当前 Run 是否已输出过元素
     std::vector<RunMetadata> generatedRuns;
 
-    // --- ȡһԪ ---
-    //      -  activeIn ȡ
-    //      - activeIn ľʱԶ standbyIn 
-    //      - ȴ inputWorker  standbyIn
-    //      - ж EOF
-    //      - ȫ busy-wait
-    bool pullNextInput(T& val, std::unique_lock<std::mutex>& lock) {
+    // 自然升序段检测（由 Compute 线程维护）
+    T treeRunMax;               // 树中属于当前 Run 的元素的上界
+    T frozenMax;                // 树中属于下一个 Run 的元素的最大值
+    long long frozenCount;      // 自上次换 Run 以来放入树中、属于下一个 Run 的元素个数
+    long long ascendingStreak;  // 连续读入且不小于 treeRunMax 的元素个数
+    PresortScanner<T> presortScanner; // Input 线程按读入顺序统计预排序程度
+
+    // 批量置换选择：每个小段是读入的一批元素排序后的结果，
+    // 小于插入时上一个输出元素的部分属于下一个 Run，被轮转到小段末尾
+    struct MiniRun {
+        std::vector<T> data;
+        size_t pos = 0;         // 下一个待输出元素（小段的队首）
+        bool empty() const { return pos >= data.size(); }
+    };
+    std::vector<MiniRun> miniRuns;  // 下标即败者树的叶子序号
+    std::vector<int> freeSlots;     // 已耗尽、可以放入新一批的小段
+    std::vector<T> batchScratch;    // sortKeys 的辅助缓冲区
+    long long liveElements = 0;     // 各小段中尚未输出的元素总数，不超过 K
+    bool batchInputDone = false;    // 输入已全部读入小段
+
+    // 每读入一批要重建一次小树，槽位数超过批大小的 8 倍时重建的分摊代价已超过逐元素重赛，也退回逐元素模式
+    static int effectiveBatchSize(int memSize, int batchElements) {
+        return batchElements > 1 && memSize / 2 >= batchElements &&
+            batchSlotCount(memSize, batchElements) <= 8LL * batchElements ? batchElements : 0;
+    }
 
-        // ʹѭṹȷԶȡ
-        while (true) {
+    // 小段槽位数：在内存中的元素不超过 K 个，但部分输出的小段仍占着槽位，因此槽位取 K / 批大小 的两倍
+    static int batchSlotCount(int memSize, int batch) {
+        return 2 * ((memSize + batch - 1) / batch);
+    }
 
-            // ---  ·activeIn пɶԪ ---
-            // activeInIdx ǵǰָ룬û size˵ buffer 
-            if (activeInIdx < activeIn->size()) {
-                val = (*activeIn)[activeInIdx++]; // ȡһԪ
-                return true;                     // ɹ
+    // --- 辅助函数：获取下一个输入元素 ---
+    //      - 从 activeIn 读取
+    //      - activeIn 耗尽时归还给 inputRing，并取得下一个已读好的块
+    //      - 读线程还没读好时在环形队列上等待（先自旋再睡眠，快路径上不加锁）
+    //      - 输入读完或收到停止信号时返回 false
+    bool pullNextInput(T& val) {
+        while (true) {
+            // --- ① 快速路径：activeIn 还有可读元素 ---
+            if (activeIn && activeInIdx < activeIn->size()) {
+                val = (*activeIn)[activeInIdx++]; // 取出一个元素
+                return true;                     // 成功
             }
 
-            // ---  active buffer ѿգ standby buffer ǷѾ ready ---
-            //  inputWorker Ѿ standbyInڿԽ
-            if (standby_input_ready) {
-                std::swap(activeIn, standbyIn); //  active / standby˫ؼ㣩
-                activeInIdx = 0;                // öָ
-                standby_input_ready = false;    //  standby Ѿ
-                cv_input.notify_one();          //  inputWorker ȥһ data
-                continue;                       //  activeIn Զȡ
+            // --- ② activeIn 已耗尽，归还给读线程 ---
+            if (activeIn) {
+                inputRing.release();
+                activeIn = nullptr;
             }
 
-            // ---  standby û׼ã active ѿ  Ƿ EOF ---
-            //  inputWorker Ѿ EOFٲκ
-            if (input_eof) return false;
-
-            // ---  standby  ready û EOF  Ҫȴ inputWorker  ---
-            // Compute ߳˯ߣֱ
-            //   - standby_input_ready = trueinputWorker һ飩
-            //   -  input_eof = trueļ꣩
-            //   -  stop_threads = trueϵͳ˳
-            cv_compute.wait(lock, [this] {
-                return standby_input_ready || input_eof || stop_threads;
-            });
-
-            // ---  յֹͣź ---
-            if (stop_threads) return false;
+            // --- ③ 取得下一个输入块；队列已空且已关闭说明到 EOF（或收到停止信号）---
+            activeIn = inputRing.acquireRead();
+            if (!activeIn) return false;
+            activeInIdx = 0;
+        }
+    }
 
-            // ѭһжϣҪô swapҪô EOFҪô·
+    // --- 辅助函数：批量获取至多 n 个输入元素 ---
+    //      直接从 activeIn 整段复制，activeIn 耗尽时由 pullNextInput 换到下一个输入块
+    //      返回实际个数，少于 n 说明输入已读完或收到停止信号
+    size_t pullInputs(T* dst, size_t n) {
+        size_t count = 0;
+        while (count < n) {
+            size_t available = activeIn ? std::min(n - count, activeIn->size() - activeInIdx) : 0;
+            if (available > 0) {
+                std::copy(activeIn->data() + activeInIdx, activeIn->data() + activeInIdx + available, dst + count);
+                activeInIdx += available;
+                count += available;
+            }
+            if (count < n) {
+                if (!pullNextInput(dst[count])) break;
+                ++count;
+            }
         }
+        return count;
     }
 
     // --- Input Worker ---
+    //      最多领先 Compute 线程 inputRing.depth() 个块；读到文件末尾后关闭 inputRing
     void inputWorker() {
-        std::unique_lock<std::mutex> lock(mtx);
         while (!stop_threads) {
-            cv_input.wait(lock, [this] { return !standby_input_ready || stop_threads; });
-            if (stop_threads) break;
+            std::vector<T>* block = inputRing.acquireWrite();
+            if (!block) break; // 收到停止信号
 
-            standbyIn->resize(bufSize);
-            lock.unlock();
-            inputFile.read(reinterpret_cast<char*>(standbyIn->data()),
-                (long long)standbyIn->size() * sizeof(T));
+            block->resize(bufSize);
+            inputFile.read(reinterpret_cast<char*>(block->data()), (long long)block->size() * sizeof(T));
             int count = (int)(inputFile.gcount() / sizeof(T));
-            lock.lock();
+            presortScanner.scan(block->data(), count);
+            block->resize(count);
 
-            standbyIn->resize(count);
-            if (inputFile.eof() || count == 0) input_eof = true;
-            standby_input_ready = true;
-            cv_compute.notify_one();
+            bool eof = inputFile.eof() || count == 0;
+            if (count > 0) inputRing.publish();
+            if (eof) break;
         }
+        inputRing.close();
     }
 
     // --- Output Worker ---
+    //      按发布顺序把每个块写到它的偏移处，outputRing 关闭且写完后退出
+    //      写盘出错时记录异常并关闭两个队列，让另外两个线程随之停止
     void outputWorker() {
-        std::unique_lock<std::mutex> lock(mtx);
-        while (!stop_threads) {
-            cv_output.wait(lock, [this] { return standby_output_busy || stop_threads; });
-            if (stop_threads) break;
-
-            int count = (int)standbyOut->size();
-            lock.unlock();
-            if (count > 0) {
-                runFilePtr->getStream().seekp(currentRunStartOffset + totalElementsInRun * sizeof(T));
-                runFilePtr->getStream().write(reinterpret_cast<char*>(standbyOut->data()),
-                    (long long)count * sizeof(T));
+        try {
+            OutputBlock* block;
+            while ((block = outputRing.acquireRead()) != nullptr) {
+                if (!block->data.empty()) {
+                    runFilePtr->getStorage().writeAt(block->data.data(), (long long)block->data.size() * sizeof(T),
+                        block->offset);
+                }
+                outputRing.release();
             }
-            lock.lock();
+        }
+        catch (...) {
+            outputError = std::current_exception();
+            stop_threads = true;
+            inputRing.close();
+            outputRing.close();
+        }
+    }
+
+    // --- 辅助函数：把 activeOut 发布给 outputWorker，并取得下一个空闲的输出块 ---
+    //      写入偏移在这里按当前 Run 已发布的元素个数确定，Compute 线程不必等待写盘完成
+    //      收到停止信号时返回 false
+    bool publishOutput() {
+        if (!activeOut) return false;
+        if (activeOut->data.empty()) return true;
+        activeOut->offset = currentRunStartOffset + totalElementsInRun * (long long)sizeof(T);
+        totalElementsInRun += (long long)activeOut->data.size();
+        outputRing.publish();
+
+        activeOut = outputRing.acquireWrite();
+        if (!activeOut) return false;
+        activeOut->data.clear();
+        return true;
+    }
+
+    // --- 辅助函数：让 input / output 线程退出并等待它们结束 ---
+    //      正常结束时 outputRing 中已发布的块会先全部写完
+    void stopThreads() {
+        stop_threads = true;
+        inputRing.close();
+        outputRing.close();
+        if (inputThread.joinable()) inputThread.join();
+        if (outputThread.joinable()) outputThread.join();
+    }
+
+    // --- 辅助函数：把一个元素追加到当前 Run 的输出 ---
+    //      - activeOut 满时发布给 outputWorker 写盘
+    //      - 收到停止信号时返回 false
+    bool emitValue(const T& value) {
+        // Run 内有序，第一个输出即最小键，最后一个即最大键
+        if (!runHasKeys) {
+            runMinKey = value;
+            runHasKeys = true;
+        }
+        runMaxKey = value;
+        activeOut->data.push_back(value);
 
-            if (count > 0) totalElementsInRun += count;
-            standby_output_busy = false;
-            cv_compute.notify_one();
+        if (activeOut->data.size() >= (size_t)bufSize) {
+            return publishOutput();
         }
+        return true;
     }
 
-    // --- Compute Worker (ʹ RunID ߼) ---
+    // --- 辅助函数：记录放入败者树的元素，维护自然升序段检测的状态 ---
+    void trackInserted(const T& val, bool frozen) {
+        if (frozen) {
+            if (frozenCount == 0 || frozenMax < val) frozenMax = val;
+            frozenCount++;
+            ascendingStreak = 0;
+        }
+        else if (!(val < treeRunMax)) {
+            treeRunMax = val;
+            ascendingStreak++;
+        }
+        else {
+            ascendingStreak = 0;
+        }
+    }
+
+    // --- 自然升序段直通 ---
+    //      树中只剩当前 Run 的元素、且连续 RG_NATURAL_RUN_MIN 个输入都不小于它们时调用：
+    //      - 先按序输出树中的所有元素
+    //      - 之后只要输入保持升序就直接输出，不再经过败者树（已排序的输入只需一次带校验的复制）
+    //      - 遇到逆序时用接下来的 K 个元素重新建树，回到置换选择
+    //      收到停止信号时返回 false
+    bool passThroughNaturalRun(int currentTreeRunID) {
+        while (!loserTree.isWinnerSentinel()) {
+            if (!emitValue(loserTree.getWinner().value)) return false;
+            loserTree.setWinnerToSentinel();
+        }
+
+        T val;
+        bool more;
+        while ((more = pullNextInput(val)) && !(val < runMaxKey)) {
+            if (!emitValue(val)) return false;
+        }
+        if (!more) return !stop_threads; // 输入读完，树已空，主循环随即结束
+
+        // val 小于刚输出的元素，属于下一个 Run
+        std::vector<RunNode<T>> nodes;
+        nodes.reserve(K);
+        frozenCount = 0;
+        ascendingStreak = 0;
+        treeRunMax = runMaxKey;
+        nodes.push_back(RunNode<T>(val, currentTreeRunID + 1));
+        trackInserted(val, true);
+        while ((int)nodes.size() < K && pullNextInput(val)) {
+            bool frozen = val < runMaxKey;
+            nodes.push_back(RunNode<T>(val, frozen ? currentTreeRunID + 1 : currentTreeRunID));
+            trackInserted(val, frozen);
+        }
+        ascendingStreak = 0;
+        loserTree.initialize(nodes);
+        return true;
+    }
+
+    // --- 辅助函数：结束当前 Run 并开启新 Run ---
+    //      发布 activeOut 并记录元数据（各块的写入偏移已确定，不必等待写盘），收到停止信号时返回 false
+    bool startNextRun() {
+        // 1. 发布 Output
+        if (!publishOutput()) return false;
+
+        // 2. 记录 Run；它的块可能还在 outputRing 中，先声明其区段，新 Run 从区段之后开始
+        if (totalElementsInRun > 0) {
+            runFilePtr->updateRunMetadata(currentRunId, currentRunStartOffset, totalElementsInRun, runMinKey, runMaxKey);
+            generatedRuns.push_back(runFilePtr->getRunMetadata(currentRunId));
+        }
+        runFilePtr->markUsedThrough(currentRunStartOffset + totalElementsInRun * (long long)sizeof(T));
+
+        // 3. 开启新 Run
+        currentRunId = runFilePtr->allocateNewRun();
+        currentRunStartOffset = runFilePtr->getAppendOffset();
+        totalElementsInRun = 0;
+        runHasKeys = false;
+
+        // 4. 树中剩下的都是原先冻结的元素
+        treeRunMax = frozenMax;
+        frozenCount = 0;
+        ascendingStreak = 0;
+        return true;
+    }
+
+    // --- 收尾：发布最后一个输出块并记录最后一个 Run ---
+    //      outputRing 随后由 generateRuns 关闭，outputWorker 写完所有块后退出
+    void finishGeneration() {
+        //发布 output
+        if (!publishOutput()) return;
+        
+        //写 metadata
+        if (totalElementsInRun > 0) {
+            runFilePtr->updateRunMetadata(currentRunId, currentRunStartOffset, totalElementsInRun, runMinKey, runMaxKey);
+            generatedRuns.push_back(runFilePtr->getRunMetadata(currentRunId));
+        }
+        runFilePtr->markUsedThrough(currentRunStartOffset + totalElementsInRun * (long long)sizeof(T));
+    }
+
+    // --- Compute Worker (使用 RunID 逻辑) ---
     void computeWorker() {
-        std::unique_lock<std::mutex> lock(mtx);
+        if (batchSize > 0) {
+            computeWorkerBatched();
+            return;
+        }
 
-        // 1. ʼ
+        // 1. 初始填充
         std::vector<T> initialData;
         initialData.reserve(K);
         T val;
-        while (initialData.size() < K && pullNextInput(val, lock)) {
+        while (initialData.size() < K && pullNextInput(val)) {
             initialData.push_back(val);
         }
 
-        // ʼĬ RunID = 1
+        // 初始化树，默认 RunID = 1
         loserTree.initialize(initialData);
+        frozenCount = 0;
+        ascendingStreak = 0;
+        if (!initialData.empty()) {
+            treeRunMax = *std::max_element(initialData.begin(), initialData.end());
+        }
+        std::vector<T>().swap(initialData); // 元素已在树中，释放填充数组（之后重建树时不与它同时存在）
 
-        int currentTreeRunID = 1; // ǰɵ Run ID
+        int currentTreeRunID = 1; // 当前正在生成的 Run ID
 
-        // 2. ѭ
+        // 2. 主循环
         while (true) {
-            // A. ȡӮ
+            // A. 获取赢家
             RunNode<T> winnerNode = loserTree.getWinner();
 
-            // B. ȫֽ (Ӯڱ -> )
+            // B. 全局结束检查 (赢家是哨兵 -> 树空了)
             if (winnerNode.runID == std::numeric_limits<int>::max()) {
                 break;
             }
 
-            // C. ǰRunwinner δ run˵ľԪض
+            // C. 当前Run结束（winner 属于未来的 run），说明输入耗尽或者元素都被冻结
             if (winnerNode.runID > currentTreeRunID) {
-                // 1. ˢ Output
-                if (!activeOut->empty()) {
-                    if (standby_output_busy)
-                        cv_compute.wait(lock, [this] { return !standby_output_busy || stop_threads; });
-                    if (stop_threads) break;
-
-                    std::swap(activeOut, standbyOut);
-                    standby_output_busy = true;
-                    cv_output.notify_one();
-                    activeOut->clear();
-                }
-
-                // 2. ȴ Output д
-                if (standby_output_busy)
-                    cv_compute.wait(lock, [this] { return !standby_output_busy || stop_threads; });
-                if (stop_threads) break;
-
-                // 3. ¼ Run
-                if (totalElementsInRun > 0) {
-                    runFilePtr->updateRunMetadata(currentRunId, currentRunStartOffset, totalElementsInRun);
-                    generatedRuns.push_back(runFilePtr->getRunMetadata(currentRunId));
-                }
-
-                // 4.  Run
-                currentRunId = runFilePtr->allocateNewRun();
-                currentRunStartOffset = runFilePtr->getAppendOffset();
-                totalElementsInRun = 0;
+                if (!startNextRun()) break;
 
-                // 5. µǰ׷ٵ RunID
+                // 更新当前追踪的 RunID：树中剩下的都是原先冻结的元素
                 currentTreeRunID = winnerNode.runID;
             }
 
-            // D. Ӯ
-            activeOut->push_back(winnerNode.value);
+            // D. 输出赢家（Output 满时发布到 outputRing，outputWorker 写盘）
+            if (!emitValue(winnerNode.value)) break;
 
-            // Output swap  standbyOutoutputWorker д
-            if (activeOut->size() >= bufSize) {
-                if (standby_output_busy)
-                    cv_compute.wait(lock, [this] { return !standby_output_busy || stop_threads; });
-                if (stop_threads) break;
-
-                std::swap(activeOut, standbyOut);
-                standby_output_busy = true;
-                cv_output.notify_one();
-                activeOut->clear();
-            }
-
-            // E. ȡֵ滻
-            if (!pullNextInput(val, lock)) {
-                // һֵýڵ㱻Ϊڱ
+            // E. 读取新值并替换
+            if (!pullNextInput(val)) {
+                // 拉不到下一个值，则该节点被设为哨兵
                 loserTree.setWinnerToSentinel();
             }
             else {
-                //һֵȽϴСжڵǰrunһrun
+                //拉到下一个值，比较大小判断属于当前run还是下一个run
                 int newRunID = (val < winnerNode.value) ? currentTreeRunID + 1 : currentTreeRunID;
                 loserTree.replaceWinner(val, newRunID);
+                trackInserted(val, newRunID > currentTreeRunID);
+
+                // 输入进入一段较长的自然升序段时绕过败者树
+                if (frozenCount == 0 && ascendingStreak >= RG_NATURAL_RUN_MIN) {
+                    if (!passThroughNaturalRun(currentTreeRunID)) break;
+                }
             }
         }
 
-        // --- β ---
-        if (standby_output_busy) cv_compute.wait(lock, [this] { return !standby_output_busy || stop_threads; });
-        
-        //ˢ output
-        if (!activeOut->empty()) {
-            std::swap(activeOut, standbyOut);
-            standby_output_busy = true;
-            cv_output.notify_one();
-            cv_compute.wait(lock, [this] { return !standby_output_busy || stop_threads; });
+        // --- 收尾 ---
+        finishGeneration();
+    }
+
+    // ================= 批量置换选择 =================
+    //      输入按 batchSize 一批批读入，每批在缓存内用 sortKeys 排成一个小段；败者树的叶子是各小段的队首，
+    //      树只有约 2K / batchSize 个叶子，常驻缓存。每输出一个元素只在这棵小树上重赛，
+    //      腾出一批的空间后读入新的一批并重建小树（代价按批分摊）。
+    //      Run 的划分规则与逐元素模式相同：小于上一个输出元素的输入属于下一个 Run，Run 长度仍约为内存的 2 倍
+
+    // 小段 slot 的队首所属的 Run：小于刚输出的元素则属于下一个 Run
+    int headRunID(const MiniRun& m, int currentTreeRunID) const {
+        return runHasKeys && m.data[m.pos] < runMaxKey ? currentTreeRunID + 1 : currentTreeRunID;
+    }
+
+    // 由各小段的队首重建败者树，空槽位为哨兵
+    void rebuildBatchTree(int currentTreeRunID) {
+        std::vector<RunNode<T>> heads(miniRuns.size(),
+            RunNode<T>(std::numeric_limits<T>::max(), std::numeric_limits<int>::max()));
+        for (size_t i = 0; i < miniRuns.size(); ++i) {
+            if (!miniRuns[i].empty()) {
+                heads[i] = RunNode<T>(miniRuns[i].data[miniRuns[i].pos], headRunID(miniRuns[i], currentTreeRunID));
+            }
         }
-        
-        //д metadata
-        if (totalElementsInRun > 0) {
-            runFilePtr->updateRunMetadata(currentRunId, currentRunStartOffset, totalElementsInRun);
-            generatedRuns.push_back(runFilePtr->getRunMetadata(currentRunId));
+        loserTree.initialize(heads);
+    }
+
+    // 把已放入空闲槽位 slot 的一批输入整理成小段：未排序时用 sortKeys 排序，
+    // 小于上一个输出元素的前缀（属于下一个 Run）轮转到末尾，使它不挡住属于当前 Run 的部分
+    void finishBatch(int slot) {
+        MiniRun& m = miniRuns[slot];
+        size_t n = m.data.size();
+        bool inputSorted = std::is_sorted(m.data.begin(), m.data.end());
+        if (!inputSorted) {
+            sortKeys(m.data.data(), m.data.data() + n, batchScratch.data());
         }
+        size_t frozen = runHasKeys ? (size_t)(std::lower_bound(m.data.begin(), m.data.end(), runMaxKey) - m.data.begin()) : 0;
 
-        // input / output ߳˳
-        stop_threads = true;
-        cv_input.notify_all();
-        cv_output.notify_all();
+        // 维护自然升序段检测的状态（按整批计入）
+        if (frozen > 0) {
+            if (frozenCount == 0 || frozenMax < m.data[frozen - 1]) frozenMax = m.data[frozen - 1];
+            frozenCount += (long long)frozen;
+            ascendingStreak = 0;
+        }
+        else if (inputSorted && !(m.data[0] < treeRunMax)) {
+            ascendingStreak += (long long)n;
+        }
+        else {
+            ascendingStreak = 0;
+        }
+        if (frozen < n && treeRunMax < m.data[n - 1]) treeRunMax = m.data[n - 1];
+
+        std::rotate(m.data.begin(), m.data.begin() + frozen, m.data.end());
+        m.pos = 0;
+        liveElements += (long long)n;
+    }
+
+    // 在内存预算内尽量读入新的批次放入空闲槽位，返回是否放入了至少一批
+    bool fillBatches() {
+        bool inserted = false;
+        while (!batchInputDone && !freeSlots.empty() && liveElements + batchSize <= K) {
+            int slot = freeSlots.back();
+            MiniRun& m = miniRuns[slot];
+            m.data.resize(batchSize);
+            size_t n = pullInputs(m.data.data(), batchSize);
+            if (n < (size_t)batchSize) batchInputDone = true;
+            m.data.resize(n);
+            m.pos = 0;
+            if (n == 0) break;
+            freeSlots.pop_back();
+            finishBatch(slot);
+            inserted = true;
+        }
+        return inserted;
+    }
+
+    // 输出当前胜者并把它所在小段的下一个元素送回树中重赛，小段耗尽时槽位变为哨兵
+    bool emitBatchWinner(int currentTreeRunID) {
+        int slot = loserTree.getWinnerIndex();
+        MiniRun& m = miniRuns[slot];
+        if (!emitValue(m.data[m.pos])) return false;
+        m.pos++;
+        liveElements--;
+        if (m.empty()) {
+            loserTree.setWinnerToSentinel();
+            freeSlots.push_back(slot);
+        }
+        else {
+            loserTree.replaceWinner(m.data[m.pos], headRunID(m, currentTreeRunID));
+        }
+        return true;
+    }
+
+    // --- 自然升序段直通（批量模式）---
+    //      与 passThroughNaturalRun 相同：按序输出所有小段，之后输入保持升序就直接输出，
+    //      遇到逆序时从逆序处开始重新读入小段。收到停止信号时返回 false
+    bool passThroughNaturalRunBatched(int currentTreeRunID) {
+        while (!loserTree.isWinnerSentinel()) {
+            if (!emitBatchWinner(currentTreeRunID)) return false;
+        }
+
+        // 所有小段都已耗尽，借用一个槽位作为直通的缓冲区
+        int slot = freeSlots.back();
+        MiniRun& m = miniRuns[slot];
+        while (true) {
+            m.data.resize(batchSize);
+            size_t n = pullInputs(m.data.data(), batchSize);
+            m.data.resize(n);
+            size_t i = 0;
+            while (i < n && !(m.data[i] < runMaxKey)) {
+                if (!emitValue(m.data[i])) return false;
+                ++i;
+            }
+            if (n < (size_t)batchSize) batchInputDone = true;
+            if (i < n) {
+                // 逆序处之后的部分作为新的第一批
+                m.data.erase(m.data.begin(), m.data.begin() + i);
+                break;
+            }
+            if (batchInputDone) {
+                m.data.clear();
+                return !stop_threads; // 输入读完，所有小段已空，主循环随即结束
+            }
+        }
+
+        frozenCount = 0;
+        ascendingStreak = 0;
+        treeRunMax = runMaxKey;
+        freeSlots.pop_back();
+        finishBatch(slot);
+        fillBatches();
+        ascendingStreak = 0;
+        rebuildBatchTree(currentTreeRunID);
+        return true;
+    }
+
+    void computeWorkerBatched() {
+
+        // 1. 初始填充：读入 K 个元素，分批排序成小段
+        miniRuns.assign(batchSlotCount(K, batchSize), MiniRun());
+        freeSlots.clear();
+        for (int i = (int)miniRuns.size() - 1; i >= 0; --i) freeSlots.push_back(i);
+        batchScratch.resize(batchSize);
+        liveElements = 0;
+        batchInputDone = false;
+        frozenCount = 0;
+        ascendingStreak = 0;
+        treeRunMax = std::numeric_limits<T>::lowest();
+
+        int currentTreeRunID = 1;
+        fillBatches();
+        rebuildBatchTree(currentTreeRunID);
+
+        // 2. 主循环
+        while (true) {
+            RunNode<T> winnerNode = loserTree.getWinner();
+
+            // 赢家是哨兵 -> 所有小段都已耗尽
+            if (winnerNode.runID == std::numeric_limits<int>::max()) {
+                break;
+            }
+
+            // 当前 Run 结束：剩下的队首都属于下一个 Run
+            if (winnerNode.runID > currentTreeRunID) {
+                if (!startNextRun()) break;
+                currentTreeRunID = winnerNode.runID;
+            }
+
+            if (!emitBatchWinner(currentTreeRunID)) break;
+
+            // 腾出一批的空间后读入新的批次，重建小段之间的败者树
+            if (!batchInputDone && !freeSlots.empty() && liveElements + batchSize <= K) {
+                if (fillBatches()) rebuildBatchTree(currentTreeRunID);
+
+                // 输入进入一段较长的自然升序段时绕过败者树
+                if (frozenCount == 0 && ascendingStreak >= RG_NATURAL_RUN_MIN) {
+                    if (!passThroughNaturalRunBatched(currentTreeRunID)) break;
+                }
+            }
+        }
+
+        // --- 收尾 ---
+        finishGeneration();
     }
 };
 
@@ -0,0 +1,95 @@
+#ifndef RUN_SEARCHER_H
+#define RUN_SEARCHER_H
+
+#include "RunFile.h"
+#include <algorithm>
+
+// 每次从磁盘读入的块大小（字节）：二分查找的一次探测读入整块，之后落在同一块内的探测不再读盘
+#ifndef RUN_SEARCHER_BLOCK_BYTES
+#define RUN_SEARCHER_BLOCK_BYTES 4096
+#endif
+
+// 在磁盘上的有序 Run 内做随机访问与二分查找（按 startOffset / elementCount 定位）
+template <typename T>
+class RunSearcher {
+private:
+    StorageBackend& storage;    // Run 文件的存储后端
+    RunMetadata runMeta;        // 此 Run 的元数据
+    long long blockElements;    // 每块的元素个数
+    IoBlock<T> block;           // 最近读入的块
+    long long cachedBlock;      // block 中是第几块（-1 表示尚未读入）
+
+    // 保证第 index 个元素所在的块已在 block 中，返回它在块内的下标
+    size_t load(long long index) {
+        long long b = index / blockElements;
+        if (b != cachedBlock) {
+            long long first = b * blockElements;
+            long long count = std::min(blockElements, runMeta.elementCount - first);
+            block.resize((size_t)count);
+            storage.readAt(block.data(), count * (long long)sizeof(T), runMeta.startOffset + first * (long long)sizeof(T));
+            cachedBlock = b;
+        }
+        return (size_t)(index - b * blockElements);
+    }
+
+    // 在 [lo, hi) 内二分：探测点所在的块整块读入，窗口收缩到一块之内后直接在内存中查找
+    template <typename Before>
+    long long partitionPoint(long long lo, long long hi, Before before) {
+        while (lo < hi) {
+            if (lo / blockElements == (hi - 1) / blockElements) {
+                size_t base = load(lo);
+                const T* first = block.data() + base;
+                return lo + (std::partition_point(first, first + (hi - lo), before) - first);
+            }
+            long long mid = lo + (hi - lo) / 2;
+            if (before(block[load(mid)])) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+public:
+    // 构造函数
+    RunSearcher(StorageBackend& backend, const RunMetadata& meta)
+        : storage(backend),
+        runMeta(meta),
+        blockElements(std::max<long long>(1, RUN_SEARCHER_BLOCK_BYTES / (long long)sizeof(T))),
+        cachedBlock(-1)
+    {
+    }
+
+    // Run 中的元素数量
+    long long size() const {
+        return runMeta.elementCount;
+    }
+
+    // 读取 Run 中第 index 个元素
+    T at(long long index) {
+        if (index < 0 || index >= runMeta.elementCount) {
+            throw std::out_of_range("Invalid index in RunSearcher::at.");
+        }
+        return block[load(index)];
+    }
+
+    // [lo, hi) 内第一个 >= value 的元素位置（不存在则为 hi）
+    long long lowerBound(const T& value, long long lo, long long hi) {
+        return partitionPoint(lo, hi, [&](const T& x) { return x < value; });
+    }
+
+    // [lo, hi) 内第一个 > value 的元素位置（不存在则为 hi）
+    long long upperBound(const T& value, long long lo, long long hi) {
+        return partitionPoint(lo, hi, [&](const T& x) { return !(value < x); });
+    }
+
+    // 第一个 >= value 的元素位置（不存在则为 size()）
+    long long lowerBound(const T& value) {
+        return lowerBound(value, 0, runMeta.elementCount);
+    }
+
+    // 第一个 > value 的元素位置（不存在则为 size()）
+    long long upperBound(const T& value) {
+        return upperBound(value, 0, runMeta.elementCount);
+    }
+};
+
+#endif // RUN_SEARCHER_H
@@ -0,0 +1,297 @@
+#ifndef SIMD_SORT_H
+#define SIMD_SORT_H
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+// 定义 SIMD_SORT_DISABLE 可关闭向量化排序与归并（总是使用标量实现）。
+// 内核依靠 GCC 的 #pragma GCC target 按函数启用指令集（MSVC 无需启用），其他编译器使用标量路径
+#if !defined(SIMD_SORT_DISABLE) && (defined(__x86_64__) || defined(_M_X64)) \
+    && ((defined(__GNUC__) && !defined(__clang__)) || defined(_MSC_VER))
+#define SIMD_SORT_AVAILABLE 1
+#else
+#define SIMD_SORT_AVAILABLE 0
+#endif
+
+// 使用向量化排序的最低指令集等级（1 = AVX2，2 = AVX-512）。
+// 1M 个键时 AVX2 内核与基数排序速度相当，AVX-512 内核约快 1.5~2.5 倍，因此默认只启用 AVX-512。
+// 向量化归并（simdMerge）不受此限制，AVX2 即可使用
+#ifndef SIMD_SORT_MIN_LEVEL
+#define SIMD_SORT_MIN_LEVEL 2
+#endif
+
+#if SIMD_SORT_AVAILABLE
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 运行时检测到的指令集等级
+enum SimdLevel {
+    SIMD_LEVEL_NONE = 0,
+    SIMD_LEVEL_AVX2 = 1,
+    SIMD_LEVEL_AVX512 = 2
+};
+
+// 通过 CPUID 检测 AVX2 / AVX-512F（同时确认操作系统保存了对应的寄存器状态），结果只计算一次
+inline SimdLevel detectSimdLevel() {
+    static const SimdLevel level = []() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx) return SIMD_LEVEL_NONE;
+        unsigned long long xcr0 = _xgetbv(0);
+        if ((xcr0 & 0x6) != 0x6) return SIMD_LEVEL_NONE;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        bool avx512f = (info[1] & (1 << 16)) != 0;
+        if (avx512f && (xcr0 & 0xE6) == 0xE6) return SIMD_LEVEL_AVX512;
+        return avx2 ? SIMD_LEVEL_AVX2 : SIMD_LEVEL_NONE;
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return SIMD_LEVEL_AVX512;
+        if (__builtin_cpu_supports("avx2")) return SIMD_LEVEL_AVX2;
+        return SIMD_LEVEL_NONE;
+#endif
+    }();
+    return level;
+}
+
+// ---------------- AVX2：8 个 32 位键或 4 个 64 位键 ----------------
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace simd_avx2 {
+
+struct Int32Ops {
+    typedef __m256i V;
+    typedef __m256i Mask;
+    static const int W = 8;
+    static const int LOG_W = 3;
+
+    static V load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    static void store(void* p, V v) { _mm256_storeu_si256(static_cast<__m256i*>(p), v); }
+    static V min(V a, V b) { return _mm256_min_epi32(a, b); }
+    static V max(V a, V b) { return _mm256_max_epi32(a, b); }
+    static V permute(V v, V idx) { return _mm256_permutevar8x32_epi32(v, idx); }
+    static V blend(V a, V b, Mask m) { return _mm256_blendv_epi8(a, b, m); }
+
+    static V indices(const int* lanes) {
+        int32_t idx[W];
+        for (int i = 0; i < W; ++i) idx[i] = lanes[i];
+        return load(idx);
+    }
+    static Mask mask(const bool* lanes) {
+        int32_t m[W];
+        for (int i = 0; i < W; ++i) m[i] = lanes[i] ? -1 : 0;
+        return load(m);
+    }
+};
+
+// AVX2 没有 64 位的 min / max，用比较加混合代替
+struct Int64Ops {
+    typedef __m256i V;
+    typedef __m256i Mask;
+    static const int W = 4;
+    static const int LOG_W = 2;
+
+    static V load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    static void store(void* p, V v) { _mm256_storeu_si256(static_cast<__m256i*>(p), v); }
+    static V min(V a, V b) { return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b)); }
+    static V max(V a, V b) { return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b)); }
+    static V permute(V v, V idx) { return _mm256_permutevar8x32_epi32(v, idx); }
+    static V blend(V a, V b, Mask m) { return _mm256_blendv_epi8(a, b, m); }
+
+    // 64 位通道 j 对应两个 32 位通道 2j、2j + 1
+    static V indices(const int* lanes) {
+        int32_t idx[2 * W];
+        for (int i = 0; i < W; ++i) {
+            idx[2 * i] = 2 * lanes[i];
+            idx[2 * i + 1] = 2 * lanes[i] + 1;
+        }
+        return load(idx);
+    }
+    static Mask mask(const bool* lanes) {
+        int64_t m[W];
+        for (int i = 0; i < W; ++i) m[i] = lanes[i] ? -1 : 0;
+        return load(m);
+    }
+};
+
+} // namespace simd_avx2
+
+#define SIMD_SORT_NS simd_avx2
+#include "SimdSortKernel.h"
+#undef SIMD_SORT_NS
+
+#ifdef __GNUC__
+#pragma GCC pop_options
+#endif
+
+// ---------------- AVX-512：16 个 32 位键或 8 个 64 位键 ----------------
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC target("avx2,avx512f")
+// GCC 的 _mm512_undefined_epi32 会触发误报的未初始化警告
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace simd_avx512 {
+
+struct Int32Ops {
+    typedef __m512i V;
+    typedef __mmask16 Mask;
+    static const int W = 16;
+    static const int LOG_W = 4;
+
+    static V load(const void* p) { return _mm512_loadu_si512(p); }
+    static void store(void* p, V v) { _mm512_storeu_si512(p, v); }
+    static V min(V a, V b) { return _mm512_min_epi32(a, b); }
+    static V max(V a, V b) { return _mm512_max_epi32(a, b); }
+    static V permute(V v, V idx) { return _mm512_permutexvar_epi32(idx, v); }
+    static V blend(V a, V b, Mask m) { return _mm512_mask_blend_epi32(m, a, b); }
+
+    static V indices(const int* lanes) {
+        int32_t idx[W];
+        for (int i = 0; i < W; ++i) idx[i] = lanes[i];
+        return load(idx);
+    }
+    static Mask mask(const bool* lanes) {
+        unsigned m = 0;
+        for (int i = 0; i < W; ++i) m |= (lanes[i] ? 1u : 0u) << i;
+        return (Mask)m;
+    }
+};
+
+struct Int64Ops {
+    typedef __m512i V;
+    typedef __mmask8 Mask;
+    static const int W = 8;
+    static const int LOG_W = 3;
+
+    static V load(const void* p) { return _mm512_loadu_si512(p); }
+    static void store(void* p, V v) { _mm512_storeu_si512(p, v); }
+    static V min(V a, V b) { return _mm512_min_epi64(a, b); }
+    static V max(V a, V b) { return _mm512_max_epi64(a, b); }
+    static V permute(V v, V idx) { return _mm512_permutexvar_epi64(idx, v); }
+    static V blend(V a, V b, Mask m) { return _mm512_mask_blend_epi64(m, a, b); }
+
+    static V indices(const int* lanes) {
+        int64_t idx[W];
+        for (int i = 0; i < W; ++i) idx[i] = lanes[i];
+        return load(idx);
+    }
+    static Mask mask(const bool* lanes) {
+        unsigned m = 0;
+        for (int i = 0; i < W; ++i) m |= (lanes[i] ? 1u : 0u) << i;
+        return (Mask)m;
+    }
+};
+
+} // namespace simd_avx512
+
+#define SIMD_SORT_NS simd_avx512
+#include "SimdSortKernel.h"
+#undef SIMD_SORT_NS
+
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+namespace simd_detail {
+
+// 按键宽度选择内核（只处理 32 / 64 位有符号整数）
+template <typename T, int Size = sizeof(T)>
+struct Dispatch {
+    static bool sort(T*, size_t, T*) { return false; }
+    static bool merge(const T*, size_t, const T*, size_t, T*) { return false; }
+};
+
+template <typename T>
+struct Dispatch<T, 4> {
+    static bool sort(T* data, size_t n, T* scratch) {
+        SimdLevel level = detectSimdLevel();
+        if (level < SIMD_SORT_MIN_LEVEL) return false;
+        switch (level) {
+        case SIMD_LEVEL_AVX512: simd_avx512::BitonicKernel<T, simd_avx512::Int32Ops>::sort(data, n, scratch); return true;
+        case SIMD_LEVEL_AVX2: simd_avx2::BitonicKernel<T, simd_avx2::Int32Ops>::sort(data, n, scratch); return true;
+        default: return false;
+        }
+    }
+
+    static bool merge(const T* a, size_t na, const T* b, size_t nb, T* out) {
+        switch (detectSimdLevel()) {
+        case SIMD_LEVEL_AVX512: simd_avx512::BitonicKernel<T, simd_avx512::Int32Ops>::merge(a, na, b, nb, out); return true;
+        case SIMD_LEVEL_AVX2: simd_avx2::BitonicKernel<T, simd_avx2::Int32Ops>::merge(a, na, b, nb, out); return true;
+        default: return false;
+        }
+    }
+};
+
+template <typename T>
+struct Dispatch<T, 8> {
+    static bool sort(T* data, size_t n, T* scratch) {
+        SimdLevel level = detectSimdLevel();
+        if (level < SIMD_SORT_MIN_LEVEL) return false;
+        switch (level) {
+        case SIMD_LEVEL_AVX512: simd_avx512::BitonicKernel<T, simd_avx512::Int64Ops>::sort(data, n, scratch); return true;
+        case SIMD_LEVEL_AVX2: simd_avx2::BitonicKernel<T, simd_avx2::Int64Ops>::sort(data, n, scratch); return true;
+        default: return false;
+        }
+    }
+
+    static bool merge(const T* a, size_t na, const T* b, size_t nb, T* out) {
+        switch (detectSimdLevel()) {
+        case SIMD_LEVEL_AVX512: simd_avx512::BitonicKernel<T, simd_avx512::Int64Ops>::merge(a, na, b, nb, out); return true;
+        case SIMD_LEVEL_AVX2: simd_avx2::BitonicKernel<T, simd_avx2::Int64Ops>::merge(a, na, b, nb, out); return true;
+        default: return false;
+        }
+    }
+};
+
+} // namespace simd_detail
+#endif // SIMD_SORT_AVAILABLE
+
+// 类型 T 是否有向量化排序内核（32 / 64 位有符号整数）
+template <typename T>
+struct SimdSortable {
+    static const bool value = SIMD_SORT_AVAILABLE && std::is_integral<T>::value && std::is_signed<T>::value
+        && (sizeof(T) == 4 || sizeof(T) == 8);
+};
+
+// 用当前 CPU 支持的最宽向量内核（寄存器内双调排序网络 + 向量化双调归并）对 [first, last) 排序。
+// scratch 至少要有 last - first 个元素的空间。类型不支持或 CPU 低于 SIMD_SORT_MIN_LEVEL 时返回 false，数据保持不变
+template <typename T>
+bool simdSort(T* first, T* last, T* scratch) {
+#if SIMD_SORT_AVAILABLE
+    if (SimdSortable<T>::value) {
+        return simd_detail::Dispatch<T, SimdSortable<T>::value ? (int)sizeof(T) : 0>::sort(first, (size_t)(last - first), scratch);
+    }
+#endif
+    (void)first; (void)last; (void)scratch;
+    return false;
+}
+
+// 用向量化双调归并内核把有序数组 a[0, na) 与 b[0, nb) 归并到 out（至少 na + nb 个元素的空间）。
+// 类型不支持或 CPU 不支持 AVX2 时返回 false，out 保持不变
+template <typename T>
+bool simdMerge(const T* a, size_t na, const T* b, size_t nb, T* out) {
+#if SIMD_SORT_AVAILABLE
+    if (SimdSortable<T>::value) {
+        return simd_detail::Dispatch<T, SimdSortable<T>::value ? (int)sizeof(T) : 0>::merge(a, na, b, nb, out);
+    }
+#endif
+    (void)a; (void)na; (void)b; (void)nb; (void)out;
+    return false;
+}
+
+#endif // SIMD_SORT_H
\ No newline at end of file
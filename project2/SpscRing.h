@@ -0,0 +1,112 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstddef>
+#include <stdexcept>
+
+// 队列满或空时，先让出 CPU 并重新检查这么多次，仍不满足才睡眠
+#ifndef SPSC_RING_SPIN
+#define SPSC_RING_SPIN 64
+#endif
+
+// 单生产者 / 单消费者环形队列：槽位本身就是块描述符，生产者就地填写后发布，消费者就地使用后归还。
+// head 只由生产者写、tail 只由消费者写，快路径上只有原子读写，不加锁；
+// 队列满或空时先自旋等待，仍不满足才在条件变量上睡眠，对方发布或归还时只在有线程睡眠的情况下才加锁唤醒
+template <typename Slot>
+class SpscRing {
+private:
+    std::vector<Slot> slots;
+    alignas(64) std::atomic<size_t> head;   // 已发布的槽位总数（生产者写）
+    alignas(64) std::atomic<size_t> tail;   // 已归还的槽位总数（消费者写）
+    alignas(64) std::atomic<bool> closed;   // 任一方关闭后不再发布新的槽位
+    std::atomic<int> sleepers;              // 正在条件变量上睡眠的线程数
+    std::mutex sleepMtx;
+    std::condition_variable sleepCv;
+
+    // 等待 ready() 成立：先自旋，再睡眠。
+    // sleepers 的增加与对方的发布都是顺序一致的原子操作，对方要么看到有线程睡眠而加锁唤醒，
+    // 要么它的发布先于这里在锁内的最后一次检查，不会丢失唤醒
+    template <typename Ready>
+    void waitFor(Ready ready) {
+        for (int i = 0; i < SPSC_RING_SPIN; ++i) {
+            if (ready()) return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(sleepMtx);
+        sleepers.fetch_add(1);
+        sleepCv.wait(lock, ready);
+        sleepers.fetch_sub(1);
+    }
+
+    void wake() {
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleepMtx);
+            sleepCv.notify_all();
+        }
+    }
+
+public:
+    explicit SpscRing(size_t depth) : slots(depth), head(0), tail(0), closed(false), sleepers(0) {
+        if (depth == 0) throw std::invalid_argument("SpscRing depth must be >= 1");
+    }
+
+    size_t depth() const {
+        return slots.size();
+    }
+
+    // 直接访问第 i 个槽位（只用于在没有线程使用队列时预先分配缓冲区）
+    Slot& at(size_t i) {
+        return slots[i];
+    }
+
+    // 清空队列并重新打开（只能在没有线程使用队列时调用）
+    void reset() {
+        head.store(0);
+        tail.store(0);
+        closed.store(false);
+    }
+
+    // --- 生产者 ---
+    // 取得下一个空闲槽位，队列满时等待；队列已关闭时返回 nullptr
+    Slot* acquireWrite() {
+        size_t h = head.load(std::memory_order_relaxed);
+        waitFor([&] { return h - tail.load() < slots.size() || closed.load(); });
+        if (closed.load()) return nullptr;
+        return &slots[h % slots.size()];
+    }
+
+    // 发布 acquireWrite 取得的槽位
+    void publish() {
+        head.store(head.load(std::memory_order_relaxed) + 1);
+        wake();
+    }
+
+    // --- 消费者 ---
+    // 取得下一个已发布的槽位，队列空时等待；队列已空且已关闭时返回 nullptr
+    Slot* acquireRead() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        waitFor([&] { return head.load() != t || closed.load(); });
+        if (head.load() == t) return nullptr;
+        return &slots[t % slots.size()];
+    }
+
+    // 归还 acquireRead 取得的槽位，生产者可以重新填写它
+    void release() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1);
+        wake();
+    }
+
+    // 关闭队列：生产者用它表示数据结束（已发布的槽位仍可读出），消费者用它让生产者停止
+    void close() {
+        closed.store(true);
+        std::lock_guard<std::mutex> lock(sleepMtx);
+        sleepCv.notify_all();
+    }
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,473 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <mutex>
+
+#ifdef _WIN32
+// 不让 windows.h 定义 min / max 宏，否则本文件及之后头文件中的 std::min、std::max、numeric_limits<T>::max() 无法编译
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <climits>
+#include <cerrno>
+#endif
+
+// 直接 I/O 要求的对齐粒度（字节）：文件偏移、读写长度和内存地址都必须是它的整数倍
+#ifndef STORAGE_IO_ALIGNMENT
+#define STORAGE_IO_ALIGNMENT 4096
+#endif
+
+// 按 STORAGE_IO_ALIGNMENT 对齐分配内存的分配器，I/O 缓冲区都用它分配，
+// 使整块读写可以不经中转直接交给直接 I/O
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() noexcept {}
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(STORAGE_IO_ALIGNMENT)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(STORAGE_IO_ALIGNMENT));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return false; }
+
+// I/O 缓冲块：起始地址按 STORAGE_IO_ALIGNMENT 对齐的 vector
+template <typename T>
+using IoBlock = std::vector<T, AlignedAllocator<T>>;
+
+// 一段连续的内存，用于聚合写（把多个块一次写到文件中连续的位置）
+struct IoSlice {
+    const void* data;
+    long long bytes;
+};
+
+// Run 文件的存储后端：所有读写都带绝对偏移，不依赖共享的读写位置，
+// 因此多个线程可以同时读写同一个文件而无需加锁或 seek
+class StorageBackend {
+public:
+    virtual ~StorageBackend() {}
+
+    // 打开已存在的文件
+    virtual bool open(const std::string& filename) = 0;
+
+    // 关闭文件
+    virtual void close() = 0;
+
+    // 从 offset 处读取 bytes 字节到 dst，读不满即抛出异常
+    virtual void readAt(void* dst, long long bytes, long long offset) = 0;
+
+    // 把 src 的 bytes 字节写到 offset 处
+    virtual void writeAt(const void* src, long long bytes, long long offset) = 0;
+
+    // 把多段内存依次写到从 offset 开始的连续区域，默认逐段写入
+    virtual void writeGather(const std::vector<IoSlice>& slices, long long offset) {
+        for (const auto& slice : slices) {
+            writeAt(slice.data, slice.bytes, offset);
+            offset += slice.bytes;
+        }
+    }
+
+    // 文件当前长度（字节）
+    virtual long long size() = 0;
+
+    // Run 起始偏移需要对齐到的字节数（1 表示没有要求）
+    virtual long long alignment() const {
+        return 1;
+    }
+
+    // 底层文件描述符，供异步 I/O 引擎直接提交请求（没有时返回 -1）
+    virtual int nativeDescriptor() const {
+        return -1;
+    }
+};
+
+// 基于 pread / pwrite 的后端（Windows 上使用带 OVERLAPPED 偏移的 ReadFile / WriteFile）
+class PositionalStorageBackend : public StorageBackend {
+protected:
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+
+public:
+    ~PositionalStorageBackend() {
+        close();
+    }
+
+#ifdef _WIN32
+protected:
+    // unbuffered 为 true 时绕过系统文件缓存（FILE_FLAG_NO_BUFFERING）
+    bool openFile(const std::string& filename, bool unbuffered) {
+        close();
+        handle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            NULL, OPEN_EXISTING, unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL, NULL);
+        return handle != INVALID_HANDLE_VALUE;
+    }
+
+    // 从 offset 处最多读取 bytes 字节，遇到文件末尾时提前返回，返回实际读到的字节数
+    long long readUpTo(void* dst, long long bytes, long long offset) {
+        char* p = static_cast<char*>(dst);
+        long long total = 0;
+        while (bytes > 0) {
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)(offset & 0xFFFFFFFF);
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+            DWORD chunk = (DWORD)std::min(bytes, (long long)(1 << 30));
+            DWORD done = 0;
+            if (!ReadFile(handle, p, chunk, &done, &ov)) {
+                if (GetLastError() == ERROR_HANDLE_EOF) break;
+                throw std::runtime_error("Failed to read run file.");
+            }
+            if (done == 0) break;
+            p += done; offset += done; bytes -= done; total += done;
+        }
+        return total;
+    }
+
+public:
+    bool open(const std::string& filename) override {
+        return openFile(filename, false);
+    }
+
+    void close() override {
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    void readAt(void* dst, long long bytes, long long offset) override {
+        if (readUpTo(dst, bytes, offset) != bytes) {
+            throw std::runtime_error("Failed to read run file.");
+        }
+    }
+
+    void writeAt(const void* src, long long bytes, long long offset) override {
+        const char* p = static_cast<const char*>(src);
+        while (bytes > 0) {
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)(offset & 0xFFFFFFFF);
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+            DWORD chunk = (DWORD)std::min(bytes, (long long)(1 << 30));
+            DWORD done = 0;
+            if (!WriteFile(handle, p, chunk, &done, &ov) || done == 0) {
+                throw std::runtime_error("Failed to write run file.");
+            }
+            p += done; offset += done; bytes -= done;
+        }
+    }
+
+    long long size() override {
+        LARGE_INTEGER li;
+        if (!GetFileSizeEx(handle, &li)) {
+            throw std::runtime_error("Failed to get run file size.");
+        }
+        return li.QuadPart;
+    }
+#else
+protected:
+    // unbuffered 为 true 时绕过页缓存：Linux 上使用 O_DIRECT，macOS 上使用 F_NOCACHE
+    bool openFile(const std::string& filename, bool unbuffered) {
+        close();
+        int flags = O_RDWR;
+#ifdef O_DIRECT
+        if (unbuffered) flags |= O_DIRECT;
+#endif
+        fd = ::open(filename.c_str(), flags);
+#ifdef F_NOCACHE
+        if (fd >= 0 && unbuffered) ::fcntl(fd, F_NOCACHE, 1);
+#endif
+        return fd >= 0;
+    }
+
+    // 从 offset 处最多读取 bytes 字节，遇到文件末尾时提前返回，返回实际读到的字节数
+    long long readUpTo(void* dst, long long bytes, long long offset) {
+        char* p = static_cast<char*>(dst);
+        long long total = 0;
+        while (bytes > 0) {
+            ssize_t done = ::pread(fd, p, (size_t)bytes, (off_t)offset);
+            if (done < 0 && errno == EINTR) continue;
+            if (done < 0) {
+                throw std::runtime_error("Failed to read run file.");
+            }
+            if (done == 0) break;
+            p += done; offset += done; bytes -= done; total += done;
+        }
+        return total;
+    }
+
+public:
+    bool open(const std::string& filename) override {
+        return openFile(filename, false);
+    }
+
+    void close() override {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    void readAt(void* dst, long long bytes, long long offset) override {
+        if (readUpTo(dst, bytes, offset) != bytes) {
+            throw std::runtime_error("Failed to read run file.");
+        }
+    }
+
+    void writeAt(const void* src, long long bytes, long long offset) override {
+        const char* p = static_cast<const char*>(src);
+        while (bytes > 0) {
+            ssize_t done = ::pwrite(fd, p, (size_t)bytes, (off_t)offset);
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) {
+                throw std::runtime_error("Failed to write run file.");
+            }
+            p += done; offset += done; bytes -= done;
+        }
+    }
+
+    // 使用 pwritev 一次系统调用写出多段内存（每次最多 IOV_MAX 段，部分写入时继续写剩余部分）
+    void writeGather(const std::vector<IoSlice>& slices, long long offset) override {
+        std::vector<struct iovec> iov;
+        size_t next = 0;
+        long long skip = 0; // 当前段中已写出的字节数
+        while (next < slices.size()) {
+            iov.clear();
+            for (size_t i = next; i < slices.size() && iov.size() < IOV_MAX; ++i) {
+                struct iovec v;
+                v.iov_base = const_cast<char*>(static_cast<const char*>(slices[i].data)) + (i == next ? skip : 0);
+                v.iov_len = (size_t)(slices[i].bytes - (i == next ? skip : 0));
+                iov.push_back(v);
+            }
+            ssize_t done = ::pwritev(fd, iov.data(), (int)iov.size(), (off_t)offset);
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) {
+                throw std::runtime_error("Failed to write run file.");
+            }
+            offset += done;
+
+            // 跳过已经完整写出的段
+            long long remaining = done;
+            while (next < slices.size() && remaining >= slices[next].bytes - skip) {
+                remaining -= slices[next].bytes - skip;
+                skip = 0;
+                ++next;
+            }
+            skip += remaining;
+        }
+    }
+
+    int nativeDescriptor() const override {
+        return fd;
+    }
+
+    long long size() override {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            throw std::runtime_error("Failed to get run file size.");
+        }
+        return (long long)st.st_size;
+    }
+#endif
+};
+
+// 直接 I/O 后端：绕过操作系统的页缓存，由排序程序自己的缓冲区负责缓存，
+// 避免排序时挤占同机其他服务的页缓存，也让顺序读写的带宽更稳定。
+// 偏移、长度和内存地址都对齐的部分直接读写；不对齐的首尾部分（文件头、目录、
+// Run 的最后一块、单个元素的随机读取）经对齐的中转缓冲区读入整块再拷贝，
+// 写入时先读出整块、修改后整块写回。文件系统不支持直接 I/O 时退回普通的 pread / pwrite。
+class DirectStorageBackend : public PositionalStorageBackend {
+private:
+    bool direct = false;        // 是否成功以直接 I/O 方式打开
+    std::mutex rmwMutex;        // 串行化不对齐写入的“读-改-写”，防止相邻写入者覆盖同一块
+
+    static bool isAligned(long long value) {
+        return value % STORAGE_IO_ALIGNMENT == 0;
+    }
+
+    static bool isAligned(const void* p) {
+        return reinterpret_cast<std::uintptr_t>(p) % STORAGE_IO_ALIGNMENT == 0;
+    }
+
+    static long long alignDown(long long value) {
+        return value / STORAGE_IO_ALIGNMENT * STORAGE_IO_ALIGNMENT;
+    }
+
+    static long long alignUp(long long value) {
+        return (value + STORAGE_IO_ALIGNMENT - 1) / STORAGE_IO_ALIGNMENT * STORAGE_IO_ALIGNMENT;
+    }
+
+    // 每次经中转缓冲区处理的最大字节数
+    static long long bounceLimit() {
+        return 64LL * STORAGE_IO_ALIGNMENT;
+    }
+
+public:
+    bool open(const std::string& filename) override {
+        direct = openFile(filename, true);
+        return direct || openFile(filename, false);
+    }
+
+    // 是否真正绕过了页缓存（文件系统不支持时为 false）
+    bool isDirect() const {
+        return direct;
+    }
+
+    long long alignment() const override {
+        return STORAGE_IO_ALIGNMENT;
+    }
+
+    void readAt(void* dst, long long bytes, long long offset) override {
+        char* p = static_cast<char*>(dst);
+        while (bytes > 0) {
+            // 1. 偏移和地址都对齐：整块直接读入目标缓冲区
+            if (isAligned(offset) && isAligned(p) && bytes >= STORAGE_IO_ALIGNMENT) {
+                long long n = alignDown(std::min(bytes, bounceLimit()));
+                PositionalStorageBackend::readAt(p, n, offset);
+                p += n; offset += n; bytes -= n;
+                continue;
+            }
+
+            // 2. 不对齐：读入覆盖该范围的整块，再拷贝需要的部分
+            long long blockStart = alignDown(offset);
+            long long skip = offset - blockStart;
+            long long n = std::min(bytes, bounceLimit() - skip);
+            IoBlock<char> bounce((size_t)alignUp(skip + n));
+            if (readUpTo(bounce.data(), (long long)bounce.size(), blockStart) < skip + n) {
+                throw std::runtime_error("Failed to read run file.");
+            }
+            std::memcpy(p, bounce.data() + skip, (size_t)n);
+            p += n; offset += n; bytes -= n;
+        }
+    }
+
+    void writeAt(const void* src, long long bytes, long long offset) override {
+        const char* p = static_cast<const char*>(src);
+        while (bytes > 0) {
+            // 1. 偏移和地址都对齐：整块直接写出
+            if (isAligned(offset) && isAligned(p) && bytes >= STORAGE_IO_ALIGNMENT) {
+                long long n = alignDown(std::min(bytes, bounceLimit()));
+                PositionalStorageBackend::writeAt(p, n, offset);
+                p += n; offset += n; bytes -= n;
+                continue;
+            }
+
+            // 2. 不对齐：读出覆盖该范围的整块（文件末尾之后补零），改写后整块写回
+            long long blockStart = alignDown(offset);
+            long long skip = offset - blockStart;
+            long long n = std::min(bytes, bounceLimit() - skip);
+            IoBlock<char> bounce((size_t)alignUp(skip + n));
+            {
+                std::lock_guard<std::mutex> lock(rmwMutex);
+                long long got = readUpTo(bounce.data(), (long long)bounce.size(), blockStart);
+                std::fill(bounce.begin() + got, bounce.end(), 0);
+                std::memcpy(bounce.data() + skip, p, (size_t)n);
+                PositionalStorageBackend::writeAt(bounce.data(), (long long)bounce.size(), blockStart);
+            }
+            p += n; offset += n; bytes -= n;
+        }
+    }
+
+    // 所有段都按块对齐时一次聚合写出，否则逐段写入
+    void writeGather(const std::vector<IoSlice>& slices, long long offset) override {
+        bool aligned = isAligned(offset);
+        for (const auto& slice : slices) {
+            aligned = aligned && isAligned(slice.data) && isAligned(slice.bytes);
+        }
+        if (aligned) {
+            PositionalStorageBackend::writeGather(slices, offset);
+        }
+        else {
+            StorageBackend::writeGather(slices, offset);
+        }
+    }
+};
+
+// 文件中一段范围的只读内存映射，用于读取已经写完、不再改变的 Run。
+// 映射整段范围并提示内核按顺序访问，读取时直接访问页缓存，省去每块一次的系统调用和拷贝。
+// 后端没有文件描述符（Windows）或映射失败时 valid() 为 false，调用者应退回普通读取
+class MappedRegion {
+private:
+    void* base;             // 映射的起始地址（按页对齐）
+    long long mappedBytes;  // 映射的总长度
+    const char* start;      // 请求范围在映射中的起点
+
+public:
+    MappedRegion(StorageBackend& backend, long long offset, long long bytes)
+        : base(nullptr), mappedBytes(0), start(nullptr)
+    {
+#ifndef _WIN32
+        int fd = backend.nativeDescriptor();
+        if (fd < 0 || bytes <= 0) return;
+        long long page = (long long)::sysconf(_SC_PAGESIZE);
+        long long alignedOffset = offset / page * page;
+        long long length = bytes + (offset - alignedOffset);
+        void* p = ::mmap(nullptr, (size_t)length, PROT_READ, MAP_SHARED, fd, (off_t)alignedOffset);
+        if (p == MAP_FAILED) return;
+        base = p;
+        mappedBytes = length;
+        start = static_cast<const char*>(p) + (offset - alignedOffset);
+        ::madvise(base, (size_t)mappedBytes, MADV_SEQUENTIAL);
+#endif
+    }
+
+    ~MappedRegion() {
+#ifndef _WIN32
+        if (base) ::munmap(base, (size_t)mappedBytes);
+#endif
+    }
+
+    MappedRegion(const MappedRegion&) = delete;
+    MappedRegion& operator=(const MappedRegion&) = delete;
+
+    bool valid() const {
+        return start != nullptr;
+    }
+
+    // 请求范围的起始地址
+    const char* data() const {
+        return start;
+    }
+
+    // 提示内核即将读取请求范围内 [from, from + bytes) 这一段，让它提前把这些页读入
+    void adviseWillNeed(long long from, long long bytes) {
+#ifndef _WIN32
+        long long page = (long long)::sysconf(_SC_PAGESIZE);
+        long long begin = (start - static_cast<const char*>(base)) + from;
+        long long end = std::min(begin + bytes, mappedBytes);
+        begin = begin / page * page;
+        if (begin >= end) return;
+        ::madvise(static_cast<char*>(base) + begin, (size_t)(end - begin), MADV_WILLNEED);
+#endif
+    }
+};
+
+#endif // STORAGE_BACKEND_H
\ No newline at end of file
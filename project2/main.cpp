@@ -1,6 +1,7 @@
 ﻿#include "RunFile.h"
 #include "RunGenerator.h"
 #include "Merger.h"
+#include "InMemorySorter.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -8,12 +9,14 @@
 #include <ctime>
 #include <climits> 
 #include <chrono>
+#include <thread>
+#include <algorithm>
 
 // --- 定义元素类型 ---
 typedef int T;
 
 // --- 配置常量 ---
-// 1. 内存限制：败者树的大小 (k) 使用 1M (1024*1024) 个整数作为内存工作区
+// 1. 内存限制：1M (1024*1024) 个整数。生成阶段按它划分置换选择的工作区与 I/O 流水线的块，归并阶段按它确定归并路数
 const int K_LOSER_TREE_SIZE = 1024 * 1024;
 
 // 2. 原始文件大小：我们要排序多少个元素 —— 10M 个元素 * 4 字节/整数 = 40MB 文件
@@ -25,6 +28,13 @@ const int IO_BUFFER_SIZE_ELEMENTS = 1024;
 // 4. 文件名
 const std::string ORIGINAL_DATA_FILE = "original_data.dat";
 const std::string RUN_STORAGE_FILE = "runs.dat";
+const std::string SORTED_OUTPUT_FILE = "sorted_data.dat"; // 输入能整个放进内存时，排序结果直接写到这里
+
+// 5. 归并段文件是否使用直接 I/O（O_DIRECT，绕过页缓存，由排序程序自己的缓冲区负责缓存）
+const bool USE_DIRECT_IO = false;
+
+// 6. 归并与验证时是否用内存映射读取已完成的 Run（直接访问页缓存，适合页缓存充足的机器）
+const bool USE_MMAP_INPUT = false;
 
 
 // 创建一个大的、未排序的原始数据文件
@@ -50,25 +60,66 @@ void createDummyDataFile() {
 bool verifySortedRun(RunFile& runFile, const RunMetadata& finalRun) {
     std::cout << "Verifying final run..." << std::endl;
 
-    InputBuffer<T> inBuf(runFile.getStream(), finalRun, IO_BUFFER_SIZE_ELEMENTS);
-
-    T lastItem;
-    T currentItem;
+    InputBuffer<T> inBuf = USE_MMAP_INPUT
+        ? InputBuffer<T>(runFile.getStorage(), finalRun, IO_BUFFER_SIZE_ELEMENTS, MappedRead())
+        : InputBuffer<T>(runFile.getStorage(), finalRun, IO_BUFFER_SIZE_ELEMENTS);
+
+    // 按块检查：直接遍历缓冲区中的连续元素，上一个值应该<=当前值
+    T lastItem = T();
+    bool first = true;
+    int count;
+    const T* span;
+    while ((span = inBuf.peekSpan(count)) != nullptr) {
+        for (int i = 0; i < count; ++i) {
+            if (!first && span[i] < lastItem) {
+                // 顺序颠倒
+                std::cerr << "Verification FAILED: " << span[i] << " < " << lastItem << std::endl;
+                return false;
+            }
+            lastItem = span[i];
+            first = false;
+        }
+        inBuf.consume(count);
+    }
 
-    if (!inBuf.getNextItem(lastItem)) {
+    if (first) {
         std::cout << "Verification complete (file was empty)." << std::endl;
-        return true;
+        return true; // 空文件认为有序
     }
 
-    while (inBuf.getNextItem(currentItem)) {
-        if (currentItem < lastItem) {
-            std::cerr << "Verification FAILED: " << currentItem << " < " << lastItem << std::endl;
-            return false;
+    std::cout << "Verification SUCCESS: Final run is sorted." << std::endl;
+    return true;
+}
+
+// 辅助函数：验证内存快速路径写出的结果文件是否正确排序
+bool verifySortedFile(const std::string& fileName) {
+    std::cout << "Verifying sorted output file..." << std::endl;
+
+    std::ifstream inFile(fileName, std::ios::in | std::ios::binary);
+    if (!inFile.is_open()) {
+        throw std::runtime_error("Could not open sorted output file.");
+    }
+
+    std::vector<T> block(IO_BUFFER_SIZE_ELEMENTS);
+    T lastItem = T();
+    bool first = true;
+    while (true) {
+        inFile.read(reinterpret_cast<char*>(block.data()), (long long)block.size() * sizeof(T));
+        int count = (int)(inFile.gcount() / sizeof(T));
+        if (count == 0) {
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (!first && block[i] < lastItem) {
+                std::cerr << "Verification FAILED: " << block[i] << " < " << lastItem << std::endl;
+                return false;
+            }
+            lastItem = block[i];
+            first = false;
         }
-        lastItem = currentItem;
     }
 
-    std::cout << "Verification SUCCESS: Final run is sorted." << std::endl;
+    std::cout << "Verification SUCCESS: Output file is sorted." << std::endl;
     return true;
 }
 
@@ -78,20 +129,41 @@ int main() {
         // --- 0. 创建假数据 ---
         createDummyDataFile();
 
+        // 输入能整个放进内存时走快速路径：并行排序后直接写出结果文件，不创建归并段文件
+        InMemorySorter<T> inMemorySorter(K_LOSER_TREE_SIZE, std::max(1, (int)std::thread::hardware_concurrency()));
+        if (inMemorySorter.fits(ORIGINAL_DATA_FILE)) {
+            std::cout << "\n--- Input fits in memory: sorting in memory ---" << std::endl;
+            auto start_sort = std::chrono::high_resolution_clock::now();
+            long long sortedCount = inMemorySorter.sortFile(ORIGINAL_DATA_FILE, SORTED_OUTPUT_FILE);
+            auto end_sort = std::chrono::high_resolution_clock::now();
+            std::cout << "In-memory sort of " << sortedCount << " elements finished in "
+                << std::chrono::duration<double>(end_sort - start_sort).count() << "s." << std::endl;
+
+            std::cout << "\n--- Verification ---" << std::endl;
+            verifySortedFile(SORTED_OUTPUT_FILE);
+            return 0;
+        }
+
         // --- 1. 初始化 RunFile ---
         RunFile runFile(RUN_STORAGE_FILE);
         if (!runFile.create(10000)) {
             throw std::runtime_error("Failed to create run file.");
         }
-        if (!runFile.open()) {
+        std::unique_ptr<StorageBackend> backend;
+        if (USE_DIRECT_IO) {
+            backend.reset(new DirectStorageBackend());
+        }
+        if (!runFile.open(std::move(backend))) {
             throw std::runtime_error("Failed to open run file.");
         }
 
         // --- 2. 阶段 1: 生成初始归并段 (使用 Project 2 的 RunGenerator) ---
         std::cout << "\n--- Phase 1: Generating Initial Runs (Project 2: Loser Tree) ---" << std::endl;
 
-        // 使用 K_LOSER_TREE_SIZE 初始化新的 RunGenerator
-        RunGenerator<T> generator(K_LOSER_TREE_SIZE);
+        // 把 K_LOSER_TREE_SIZE 作为生成阶段的总内存预算，划分给置换选择的工作区与 I/O 流水线的块
+        RunGeneratorLayout layout = RunGenerator<T>::layoutForMemory(K_LOSER_TREE_SIZE);
+        layout.print(std::cout);
+        RunGenerator<T> generator(layout);
 
         auto start_gen = std::chrono::high_resolution_clock::now();
 
@@ -120,8 +192,12 @@ int main() {
         // --- 3. 阶段 2: 归并合并 (使用 Project 2 的 Merger) ---
         std::cout << "\n--- Phase 2: Merging Runs (Project 2: Optimal Merge Tree) ---" << std::endl;
 
-        // Merger 类包含了新的 externalMergeSort (使用最小堆)
-        Merger<T> merger;
+        // Merger 类包含了新的 externalMergeSort (使用最小堆)，归并路数由内存大小决定
+        // 互不相交的归并由多个线程并发执行，所有并发归并的缓冲区总和不超过同一内存预算
+        int mergeThreads = std::max(1u, std::thread::hardware_concurrency());
+        // K 路归并的所有输入共享一个按预测顺序填充的预读块池
+        Merger<T> merger(Merger<T>::fanInForMemory(K_LOSER_TREE_SIZE, MERGE_PREFETCH_POOL_BLOCKS),
+            mergeThreads, K_LOSER_TREE_SIZE, MERGE_PREFETCH_POOL_BLOCKS, USE_MMAP_INPUT);
 
         auto start_merge = std::chrono::high_resolution_clock::now();
 